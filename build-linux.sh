@@ -7,6 +7,9 @@ GAME_NAME="Hoard"
 # SOURCES="src/*.c src/submodule/*.c"
 SOURCES="src/*.c"
 
+# Images packed into the asset bundle next to the executable (relative paths!)
+ASSETS="builds/linux/*.png"
+
 # Set your raylib/src location here (relative path!)
 RAYLIB_SRC="../../../../Documents/raylib/src/"
 
@@ -21,12 +24,16 @@ RAYLIB_SRC="../../../../Documents/raylib/src/"
 set -e
 
 # Get arguments
-while getopts ":hdusrcq" opt; do
+while getopts ":hdbmusrcq" opt; do
     case $opt in
         h)
-            echo "Usage: ./build-linux.sh [-hdusrcqq]"
+            echo "Usage: ./build-linux.sh [-hdbmusrcqq]"
             echo " -h  Show this information"
             echo " -d  Faster builds that have debug symbols, and enable warnings"
+            echo " -b  Build the headless simulation ($GAME_NAME-headless), no window"
+            echo "     and no raylib objects, for profiling on machines without X11"
+            echo " -m  Build the headless simulation and run the benchmark suite, the"
+            echo "     results go to bench.jsonl next to the executable"
             echo " -u  Run upx* on the executable after compilation (before -r)"
             echo " -s  Run strip on the executable after compilation (before -r)"
             echo " -r  Run the executable after compilation"
@@ -43,11 +50,21 @@ while getopts ":hdusrcq" opt; do
             echo " Build a release build, full recompile:    ./build-linux.sh -c"
             echo " Build a debug build and run:              ./build-linux.sh -d -r"
             echo " Build in debug, run, don't print at all:  ./build-linux.sh -drqq"
+            echo " Build headless and run the tick benchmark: ./build-linux.sh -b -r"
+            echo " Build and run the benchmark suite:         ./build-linux.sh -m"
             exit 0
             ;;
         d)
             BUILD_DEBUG="1"
             ;;
+        b)
+            BUILD_HEADLESS="1"
+            ;;
+        m)
+            BUILD_HEADLESS="1"
+            BUILD_BENCH="1"
+            RUN_AFTER_BUILD="1"
+            ;;
         u)
             UPX_IT="1"
             ;;
@@ -82,6 +99,7 @@ fi
 # Directories
 ROOT_DIR=$PWD
 SOURCES="$ROOT_DIR/$SOURCES"
+ASSETS="$ROOT_DIR/$ASSETS"
 RAYLIB_SRC="$ROOT_DIR/$RAYLIB_SRC"
 
 # Flags
@@ -97,6 +115,20 @@ if [ -n "$BUILD_DEBUG" ]; then
     FINAL_COMPILE_FLAGS=""
     LINK_FLAGS="-lm -ldl -lpthread -lX11 -lxcb -lGL -lGLX -lXext -lGLdispatch -lXau -lXdmcp"
 fi
+# Headless changes to flags, only raylib's headers are used
+if [ -n "$BUILD_HEADLESS" ]; then
+    GAME_NAME="$GAME_NAME-headless"
+    RUN_ARGS="--headless"
+    if [ -n "$BUILD_BENCH" ]; then
+        RUN_ARGS="--headless --bench --json bench.jsonl"
+    fi
+    COMPILATION_FLAGS="$COMPILATION_FLAGS -DHEADLESS"
+    if [ -n "$BUILD_DEBUG" ]; then
+        LINK_FLAGS="-lm -lpthread"
+    else
+        LINK_FLAGS="-flto -lm -lpthread"
+    fi
+fi
 
 # Display what we're doing
 if [ -n "$BUILD_DEBUG" ]; then
@@ -115,8 +147,8 @@ if [ -d "$TEMP_DIR" ] && [ -n "$BUILD_ALL" ]; then
     [ -z "$QUIET" ] && echo "COMPILE-INFO: Found cached raylib, rebuilding."
     rm -r "$TEMP_DIR"
 fi
-# If temp directory doesn't exist, build raylib
-if [ ! -d "$TEMP_DIR" ]; then
+# If temp directory doesn't exist, build raylib (headless builds don't need it)
+if [ ! -d "$TEMP_DIR" ] && [ -z "$BUILD_HEADLESS" ]; then
     mkdir -p $TEMP_DIR
     cd $TEMP_DIR
     RAYLIB_DEFINES="-D_DEFAULT_SOURCE -DPLATFORM_DESKTOP -DGRAPHICS_API_OPENGL_33"
@@ -136,16 +168,34 @@ fi
 mkdir -p $OUTPUT_DIR
 cd $OUTPUT_DIR
 [ -z "$QUIET" ] && echo "COMPILE-INFO: Compiling game code."
+RAYLIB_OBJECTS="$ROOT_DIR/$TEMP_DIR/*.o"
+if [ -n "$BUILD_HEADLESS" ]; then
+    RAYLIB_OBJECTS=""
+fi
 if [ -n "$REALLY_QUIET" ]; then
     $CC -c -I$RAYLIB_SRC $COMPILATION_FLAGS $WARNING_FLAGS $SOURCES > /dev/null 2>&1
-    $CC -o $GAME_NAME $ROOT_DIR/$TEMP_DIR/*.o *.o $LINK_FLAGS > /dev/null 2>&1
+    $CC -o $GAME_NAME $RAYLIB_OBJECTS *.o $LINK_FLAGS > /dev/null 2>&1
 else
     $CC -c -I$RAYLIB_SRC $COMPILATION_FLAGS $WARNING_FLAGS $SOURCES
-    $CC -o $GAME_NAME $ROOT_DIR/$TEMP_DIR/*.o *.o $LINK_FLAGS
+    $CC -o $GAME_NAME $RAYLIB_OBJECTS *.o $LINK_FLAGS
 fi
 rm *.o
 [ -z "$QUIET" ] && echo "COMPILE-INFO: Game compiled into an executable in: $OUTPUT_DIR/"
 
+# Pack the images into a bundle of decoded pixels, the game falls back to
+# the loose files when it isn't there
+if [ -z "$BUILD_HEADLESS" ]; then
+    PACKER="$ROOT_DIR/temp/packassets"
+    if [ -n "$REALLY_QUIET" ]; then
+        $CC -std=c99 -O2 -I$RAYLIB_SRC/external -o $PACKER $ROOT_DIR/tools/packassets.c -lm > /dev/null 2>&1
+        $PACKER assets.pak $ASSETS > /dev/null 2>&1
+    else
+        $CC -std=c99 -O2 -I$RAYLIB_SRC/external -o $PACKER $ROOT_DIR/tools/packassets.c -lm
+        $PACKER assets.pak $ASSETS
+    fi
+    [ -z "$QUIET" ] && echo "COMPILE-INFO: Assets packed into: $OUTPUT_DIR/assets.pak"
+fi
+
 if [ -n "$STRIP_IT" ]; then
     [ -z "$QUIET" ] && echo "COMPILE-INFO: Stripping $GAME_NAME."
     strip $GAME_NAME
@@ -159,9 +209,9 @@ fi
 if [ -n "$RUN_AFTER_BUILD" ]; then
     [ -z "$QUIET" ] && echo "COMPILE-INFO: Running."
     if [ -n "$REALLY_QUIET" ]; then
-        ./$GAME_NAME > /dev/null 2>&1
+        ./$GAME_NAME $RUN_ARGS > /dev/null 2>&1
     else
-        ./$GAME_NAME
+        ./$GAME_NAME $RUN_ARGS
     fi
 fi
 cd $ROOT_DIR
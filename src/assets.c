@@ -0,0 +1,104 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "assets.h"
+#include "bundle.h"
+
+#ifndef HEADLESS
+static unsigned char *bundleBase;
+static size_t bundleSize;
+static const struct bundleEntry *entries;
+static int entryCount;
+static char assetDir[4096];
+
+// Map the bundle and check its index, so lookups can trust every entry
+static int bundleMap(const char *path)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd == -1)
+    return -1;
+  struct stat st;
+  if (fstat(fd, &st) || (size_t) st.st_size < sizeof(struct bundleHeader))
+  {
+    close(fd);
+    return -1;
+  }
+  unsigned char *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return -1;
+
+  size_t size = st.st_size;
+  const struct bundleHeader *header = (const struct bundleHeader *) base;
+  const struct bundleEntry *index = (const struct bundleEntry *) (header + 1);
+  int ok = !memcmp(header->magic, BUNDLEMAGIC, 4) && header->version == BUNDLEVERSION &&
+    header->count >= 0 && (size - sizeof(*header)) / sizeof(*index) >= (size_t) header->count;
+  for (int i = 0; ok && i < header->count; ++i)
+    ok = index[i].width > 0 && index[i].height > 0 && index[i].offset >= 0 &&
+      (long long) index[i].width * index[i].height * 4 == index[i].length &&
+      (size_t) index[i].offset + index[i].length <= size &&
+      memchr(index[i].name, 0, BUNDLENAMESIZE);
+  if (!ok)
+  {
+    TraceLog(LOG_WARNING, "ASSETS: %s is not a valid bundle, using loose files", path);
+    munmap(base, size);
+    return -1;
+  }
+  bundleBase = base;
+  bundleSize = size;
+  entries = index;
+  entryCount = header->count;
+  return 0;
+}
+
+int assetsOpen(const char *dir)
+{
+  assetsClose();
+  snprintf(assetDir, sizeof(assetDir), "%s", dir ? dir : "");
+  // raylib gives the application directory with its trailing slash
+  size_t n = strlen(assetDir);
+  if (n && assetDir[n - 1] != '/' && n + 1 < sizeof(assetDir))
+    strcpy(assetDir + n, "/");
+  char path[4096 + BUNDLENAMESIZE];
+  snprintf(path, sizeof(path), "%s%s", assetDir, BUNDLEFILE);
+  return bundleMap(path) == 0;
+}
+
+int assetsClose()
+{
+  if (bundleBase)
+    munmap(bundleBase, bundleSize);
+  bundleBase = NULL;
+  entries = NULL;
+  entryCount = 0;
+  return 0;
+}
+
+Image assetImage(const char *name)
+{
+  for (int i = 0; i < entryCount; ++i)
+    if (!strcmp(entries[i].name, name))
+      // Points straight into the mapping, nothing to decode or copy
+      return (Image){ bundleBase + entries[i].offset, entries[i].width, entries[i].height, 1, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8 };
+
+  // Next to the executable, then wherever we were started from
+  char path[4096 + BUNDLENAMESIZE];
+  snprintf(path, sizeof(path), "%s%s", assetDir, name);
+  if (!FileExists(path))
+    return LoadImage(name);
+  return LoadImage(path);
+}
+
+int assetRelease(Image image)
+{
+  unsigned char *data = image.data;
+  if (bundleBase && data >= bundleBase && data < bundleBase + bundleSize)
+    return 0;
+  UnloadImage(image);
+  return 0;
+}
+#endif /* ifndef HEADLESS */
@@ -0,0 +1,18 @@
+#ifndef ASSETS_H
+#define ASSETS_H
+
+#include <raylib.h>
+
+// Images come from the asset bundle when there is one next to the
+// executable, and are loaded from the loose files otherwise (e.g. while
+// working on them)
+
+// Look for the bundle and loose files in dir, returns 1 if the bundle is used
+int assetsOpen(const char *dir);
+// Unmap the bundle, every image from it has to be released first
+int assetsClose();
+// Get an image by file name, its data is empty if it can't be found
+Image assetImage(const char *name);
+int assetRelease(Image image);
+
+#endif /* ASSETS_H */
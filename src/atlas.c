@@ -0,0 +1,109 @@
+#include <rlgl.h>
+#include "assets.h"
+#include "atlas.h"
+
+// Width of the atlas, sprites are packed in rows across it
+#define ATLASWIDTH 64
+// Empty pixels around each sprite so filtering never reads its neighbours
+#define ATLASPADDING 1
+
+#ifndef HEADLESS
+static const char *spriteFiles[SPRITECOUNT] = {
+  [SPRITE_MANLEFT] = "ManLeft.png",
+  [SPRITE_MANLEFTWALK1] = "ManLeftWalk1.png",
+  [SPRITE_MANLEFTWALK2] = "ManLeftWalk2.png",
+  [SPRITE_MANRIGHT] = "ManRight.png",
+  [SPRITE_MANRIGHTWALK1] = "ManRightWalk1.png",
+  [SPRITE_MANRIGHTWALK2] = "ManRightWalk2.png",
+  [SPRITE_ZOMBIELEFTWALK1] = "Zombie2LeftWalk1.png",
+  [SPRITE_ZOMBIELEFTWALK2] = "Zombie2LeftWalk2.png",
+  [SPRITE_ZOMBIERIGHTWALK1] = "Zombie2RightWalk1.png",
+  [SPRITE_ZOMBIERIGHTWALK2] = "Zombie2RightWalk2.png",
+};
+
+int atlasLoad(struct spriteAtlas *atlas)
+{
+  Image images[SPRITECOUNT];
+  // Lay the sprites out in rows, a new row starts when one doesn't fit
+  int x = ATLASPADDING, y = ATLASPADDING, rowHeight = 0;
+  for (int i = 0; i < SPRITECOUNT; ++i)
+  {
+    images[i] = assetImage(spriteFiles[i]);
+    // A missing sprite just draws nothing
+    int w = images[i].data ? images[i].width : 0;
+    int h = images[i].data ? images[i].height : 0;
+    if (x + w + ATLASPADDING > ATLASWIDTH && x > ATLASPADDING)
+    {
+      x = ATLASPADDING;
+      y += rowHeight + ATLASPADDING;
+      rowHeight = 0;
+    }
+    atlas->rects[i] = (Rectangle){ x, y, w, h };
+    x += w + ATLASPADDING;
+    if (h > rowHeight) rowHeight = h;
+  }
+  int height = y + rowHeight + ATLASPADDING;
+  // Power of two sides keep older GPUs happy
+  int side = 1;
+  while (side < height) side <<= 1;
+
+  Image sheet = GenImageColor(ATLASWIDTH, side, BLANK);
+  for (int i = 0; i < SPRITECOUNT; ++i)
+  {
+    if (images[i].data)
+      ImageDraw(&sheet, images[i], (Rectangle){ 0, 0, images[i].width, images[i].height }, atlas->rects[i], WHITE);
+    assetRelease(images[i]);
+  }
+  atlas->texture = LoadTextureFromImage(sheet);
+  UnloadImage(sheet);
+  return 0;
+}
+
+int atlasFree(struct spriteAtlas *atlas)
+{
+  UnloadTexture(atlas->texture);
+  return 0;
+}
+
+int atlasDraw(const struct spriteAtlas *atlas, int sprite, Vector2 pos, float scale)
+{
+  Rectangle src = atlas->rects[sprite];
+  DrawTexturePro(atlas->texture, src, (Rectangle){ pos.x, pos.y, src.width * scale, src.height * scale }, (Vector2){ 0, 0 }, 0.f, WHITE);
+  return 0;
+}
+
+int atlasBegin(const struct spriteAtlas *atlas)
+{
+  rlSetTexture(atlas->texture.id);
+  rlBegin(RL_QUADS);
+  rlColor4ub(255, 255, 255, 255);
+  rlNormal3f(0.f, 0.f, 1.f);
+  return 0;
+}
+
+int atlasQuad(const struct spriteAtlas *atlas, int sprite, Rectangle dest)
+{
+  // Flushes the batch when it's full, keeping the texture and mode set
+  rlCheckRenderBatchLimit(4);
+  Rectangle src = atlas->rects[sprite];
+  float u0 = src.x / atlas->texture.width, u1 = (src.x + src.width) / atlas->texture.width;
+  float v0 = src.y / atlas->texture.height, v1 = (src.y + src.height) / atlas->texture.height;
+  // Same corner order as DrawTexturePro
+  rlTexCoord2f(u0, v0);
+  rlVertex2f(dest.x, dest.y);
+  rlTexCoord2f(u0, v1);
+  rlVertex2f(dest.x, dest.y + dest.height);
+  rlTexCoord2f(u1, v1);
+  rlVertex2f(dest.x + dest.width, dest.y + dest.height);
+  rlTexCoord2f(u1, v0);
+  rlVertex2f(dest.x + dest.width, dest.y);
+  return 0;
+}
+
+int atlasEnd()
+{
+  rlEnd();
+  rlSetTexture(0);
+  return 0;
+}
+#endif /* ifndef HEADLESS */
@@ -0,0 +1,41 @@
+#ifndef ATLAS_H
+#define ATLAS_H
+
+#include <raylib.h>
+
+// Every sprite, in the order they are packed
+enum sprite
+{
+  SPRITE_MANLEFT,
+  SPRITE_MANLEFTWALK1,
+  SPRITE_MANLEFTWALK2,
+  SPRITE_MANRIGHT,
+  SPRITE_MANRIGHTWALK1,
+  SPRITE_MANRIGHTWALK2,
+  SPRITE_ZOMBIELEFTWALK1,
+  SPRITE_ZOMBIELEFTWALK2,
+  SPRITE_ZOMBIERIGHTWALK1,
+  SPRITE_ZOMBIERIGHTWALK2,
+  SPRITECOUNT
+};
+
+// All the sprites packed into one texture, so drawing any mix of them never
+// has to switch textures and raylib can keep them in one batch
+struct spriteAtlas
+{
+  Texture2D texture;
+  Rectangle rects[SPRITECOUNT]; // Where each sprite is in the texture
+};
+
+// Load every sprite's image and pack them into the atlas texture
+int atlasLoad(struct spriteAtlas *atlas);
+int atlasFree(struct spriteAtlas *atlas);
+// Draw one sprite with its top left corner at pos, scale times its size
+int atlasDraw(const struct spriteAtlas *atlas, int sprite, Vector2 pos, float scale);
+// Start a stream of quads from the atlas, for drawing lots of sprites at once
+int atlasBegin(const struct spriteAtlas *atlas);
+// Add a sprite to the stream, filling dest
+int atlasQuad(const struct spriteAtlas *atlas, int sprite, Rectangle dest);
+int atlasEnd();
+
+#endif /* ATLAS_H */
@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+#include "bake.h"
+#include "rng.h"
+
+// Each bake has its own allocation, so growing the pool doesn't move them
+static struct chunkBake **pool;
+static int poolSize;
+static Color grassPixels[BAKETILESIZE * BAKETILESIZE];
+// A block is drawn and uploaded at a time
+static Color scratch[BAKEBLOCK * BAKETILESIZE * BAKEBLOCK * BAKETILESIZE];
+
+#ifndef HEADLESS
+int bakeSetGrass(Image grass)
+{
+  Image scaled = ImageCopy(grass);
+  ImageFormat(&scaled, PIXELFORMAT_UNCOMPRESSED_R8G8B8A8);
+  ImageResize(&scaled, BAKETILESIZE, BAKETILESIZE);
+  memcpy(grassPixels, scaled.data, sizeof(grassPixels));
+  UnloadImage(scaled);
+  return 0;
+}
+
+int bakeFree()
+{
+  for (int i = 0; i < poolSize; ++i)
+  {
+    UnloadTexture(pool[i]->texture);
+    free(pool[i]);
+  }
+  free(pool);
+  pool = NULL;
+  poolSize = 0;
+  return 0;
+}
+#endif /* ifndef HEADLESS */
+
+int bakeReserve(int count)
+{
+  if (count <= poolSize)
+    return 0;
+  struct chunkBake **grown = realloc(pool, sizeof(*pool) * count);
+  if (!grown)
+    return -1;
+  pool = grown;
+  #ifndef HEADLESS
+  Image blank = GenImageColor(CHUNKSIZE * BAKETILESIZE, CHUNKSIZE * BAKETILESIZE, BLANK);
+  #endif /* ifndef HEADLESS */
+  for (; poolSize < count; ++poolSize)
+  {
+    struct chunkBake *bake = calloc(1, sizeof(*bake));
+    if (!bake)
+      break;
+    #ifndef HEADLESS
+    bake->texture = LoadTextureFromImage(blank);
+    SetTextureFilter(bake->texture, TEXTURE_FILTER_BILINEAR);
+    #endif /* ifndef HEADLESS */
+    pool[poolSize] = bake;
+  }
+  #ifndef HEADLESS
+  UnloadImage(blank);
+  #endif /* ifndef HEADLESS */
+  return poolSize < count ? -1 : 0;
+}
+
+struct chunkBake *bakeFind(int x, int y)
+{
+  for (int i = 0; i < poolSize; ++i)
+    if (pool[i]->held && pool[i]->x == x && pool[i]->y == y)
+      return pool[i];
+  return NULL;
+}
+
+struct chunkBake *bakeTake(int x, int y, unsigned int stamp)
+{
+  struct chunkBake *bake = bakeFind(x, y);
+  if (!bake)
+  {
+    // Empty ones first, then the one taken longest ago
+    for (int i = 0; i < poolSize; ++i)
+    {
+      struct chunkBake *b = pool[i];
+      if (b->held && b->used == stamp)
+        continue;
+      if (!bake || (bake->held && (!b->held || stamp - b->used > stamp - bake->used)))
+        bake = b;
+    }
+    if (!bake)
+      return NULL;
+    bake->held = 1;
+    bake->x = x;
+    bake->y = y;
+    bakeMarkAll(bake);
+  }
+  bake->used = stamp;
+  return bake;
+}
+
+int bakeForget(int x, int y)
+{
+  struct chunkBake *bake = bakeFind(x, y);
+  if (bake)
+    bake->held = 0;
+  return 0;
+}
+
+int bakeForgetAll()
+{
+  for (int i = 0; i < poolSize; ++i)
+    pool[i]->held = 0;
+  return 0;
+}
+
+int bakeMarkDirty(struct chunkBake *bake, int x0, int y0, int x1, int y1)
+{
+  for (int bx = x0 / BAKEBLOCK; bx * BAKEBLOCK < x1; ++bx)
+    for (int by = y0 / BAKEBLOCK; by * BAKEBLOCK < y1; ++by)
+    {
+      // The part of the area in this block, from its corner
+      int cx = bx * BAKEBLOCK, cy = by * BAKEBLOCK;
+      int lx0 = x0 > cx ? x0 - cx : 0, ly0 = y0 > cy ? y0 - cy : 0;
+      int lx1 = x1 < cx + BAKEBLOCK ? x1 - cx : BAKEBLOCK, ly1 = y1 < cy + BAKEBLOCK ? y1 - cy : BAKEBLOCK;
+      unsigned char *d = bake->dirty[bx][by];
+      if (d[0] >= d[2] || d[1] >= d[3])
+      {
+        d[0] = lx0; d[1] = ly0; d[2] = lx1; d[3] = ly1;
+        continue;
+      }
+      // Grow the dirty area to cover both
+      if (lx0 < d[0]) d[0] = lx0;
+      if (ly0 < d[1]) d[1] = ly0;
+      if (lx1 > d[2]) d[2] = lx1;
+      if (ly1 > d[3]) d[3] = ly1;
+    }
+  return 0;
+}
+
+int bakeMarkAll(struct chunkBake *bake)
+{
+  return bakeMarkDirty(bake, 0, 0, CHUNKSIZE, CHUNKSIZE);
+}
+
+// Same colours the tiles were always tinted with: grass in three shades, red when solid
+static Color tileColour(char tile, int shade)
+{
+  Color col = { 0, 128, 45, 255 };
+  col.g = 128 + 4 * (shade % 3);
+  col.g *= 1 - tile;
+  col.r = 200 * tile;
+  return col;
+}
+
+// Redraw tiles x0 to x1 and y0 to y1 (end exclusive) and upload them
+static int drawTiles(struct chunkBake *bake, const struct mapChunk *chunk, unsigned int seed, int x0, int y0, int x1, int y1)
+{
+  int originX = CHUNKSIZE * (int) chunk->pos.x, originY = CHUNKSIZE * (int) chunk->pos.y;
+  int stride = (x1 - x0) * BAKETILESIZE;
+  for (int ty = y0; ty < y1; ++ty)
+    for (int tx = x0; tx < x1; ++tx)
+    {
+      unsigned int shade = rngHash(seed, RNGSTREAM_TILES, originX + tx, originY + ty);
+      Color col = tileColour(chunk->tiles[tx][ty], shade % 3);
+      Color *out = &scratch[(ty - y0) * BAKETILESIZE * stride + (tx - x0) * BAKETILESIZE];
+      const Color *in = grassPixels;
+      for (int py = 0; py < BAKETILESIZE; ++py, out += stride)
+        for (int px = 0; px < BAKETILESIZE; ++px, ++in)
+        {
+          // Tint the same way raylib does when drawing a texture
+          out[px].r = in->r * col.r / 255;
+          out[px].g = in->g * col.g / 255;
+          out[px].b = in->b * col.b / 255;
+          out[px].a = in->a * col.a / 255;
+        }
+    }
+  #ifndef HEADLESS
+  UpdateTextureRec(bake->texture, (Rectangle){ x0 * BAKETILESIZE, y0 * BAKETILESIZE, stride, (y1 - y0) * BAKETILESIZE }, scratch);
+  #else
+  (void) bake;
+  #endif /* ifndef HEADLESS */
+  return (x1 - x0) * (y1 - y0);
+}
+
+int bakeUpdate(struct chunkBake *bake, const struct mapChunk *chunk, unsigned int seed, const int range[4], int budget)
+{
+  int drawn = 0;
+  for (int bx = range[0] / BAKEBLOCK; bx * BAKEBLOCK < range[1]; ++bx)
+    for (int by = range[2] / BAKEBLOCK; by * BAKEBLOCK < range[3]; ++by)
+    {
+      unsigned char *d = bake->dirty[bx][by];
+      if (d[0] >= d[2] || d[1] >= d[3] || drawn >= budget)
+        continue;
+      int cx = bx * BAKEBLOCK, cy = by * BAKEBLOCK;
+      drawn += drawTiles(bake, chunk, seed, cx + d[0], cy + d[1], cx + d[2], cy + d[3]);
+      memset(d, 0, 4);
+    }
+  return drawn;
+}
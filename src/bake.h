@@ -0,0 +1,56 @@
+#ifndef BAKE_H
+#define BAKE_H
+
+#include <raylib.h>
+#include "world.h"
+
+// Pixels per tile in a baked chunk, the grass texture is scaled down to this
+#define BAKETILESIZE 16
+// Tiles across a block, the dirty areas are kept by block
+#define BAKEBLOCK 16
+#define BAKEBLOCKS (CHUNKSIZE / BAKEBLOCK)
+
+// An on screen chunk's ground drawn into one texture, so drawing the world
+// is a few quads instead of a draw call per tile. Each block of tiles keeps
+// the part of it that needs redrawing, so only what is on screen gets drawn
+// and a new chunk is drawn a few blocks at a time as it comes into view.
+// The bakes are shared, a chunk gets one when it comes on screen and keeps
+// it until another chunk needs it. There are as many as the most chunks
+// the screen has shown at once, usually 4.
+struct chunkBake
+{
+  Texture2D texture;
+  int held;     // x and y are the chunk drawn into it
+  int x, y;
+  unsigned int used; // Stamp it was last taken with
+  // By block, the tiles in it that need redrawing { x0, y0, x1, y1 } from
+  // the block's corner, end exclusive
+  unsigned char dirty[BAKEBLOCKS][BAKEBLOCKS][4];
+};
+
+// Set the tile image every tile is tinted from
+int bakeSetGrass(Image grass);
+// Have at least count bakes, for count chunks on screen. Headless they
+// have no textures and nothing is uploaded.
+int bakeReserve(int count);
+int bakeFree();
+// The bake holding chunk (x, y), NULL if none does
+struct chunkBake *bakeFind(int x, int y);
+// The bake holding chunk (x, y), if none does the one taken longest ago
+// is given to it with everything dirty. The bake is stamped with stamp,
+// ones taken with the same stamp aren't given away; NULL if they all were.
+struct chunkBake *bakeTake(int x, int y, unsigned int stamp);
+// The chunk's tiles were replaced, its bake can't be kept
+int bakeForget(int x, int y);
+int bakeForgetAll();
+// Add tiles to the area that will be redrawn on the next update
+int bakeMarkDirty(struct chunkBake *bake, int x0, int y0, int x1, int y1);
+int bakeMarkAll(struct chunkBake *bake);
+// Redraw the dirty tiles of chunk in the blocks that overlap range
+// { x0, x1, y0, y1 } (as chunkVisibleRange gives it) and upload them. Stops
+// starting blocks once budget tiles have been redrawn, the rest wait for
+// the next update. Returns how many were redrawn. Each tile's shade of
+// grass comes from its position and seed.
+int bakeUpdate(struct chunkBake *bake, const struct mapChunk *chunk, unsigned int seed, const int range[4], int budget);
+
+#endif /* BAKE_H */
@@ -0,0 +1,32 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+// The asset bundle written by tools/packassets.c and read by assets.c. It
+// is a header, an index with an entry per image, then each image's pixels
+// already decoded to RGBA, so loading one is a pointer into the mapped
+// file. Everything is in the byte order of the machine that packed it.
+#define BUNDLEMAGIC "HPAK"
+#define BUNDLEVERSION 1
+#define BUNDLEFILE "assets.pak"
+#define BUNDLENAMESIZE 32
+// Pixels of each image start on a cache line
+#define BUNDLEALIGN 64
+
+struct bundleHeader
+{
+  char magic[4];
+  int version;
+  int count; // Entries in the index straight after the header
+  int reserved;
+};
+
+struct bundleEntry
+{
+  char name[BUNDLENAMESIZE]; // File name the image was packed from
+  int width;
+  int height;
+  int offset; // From the start of the file
+  int length; // width * height * 4 bytes of RGBA
+};
+
+#endif /* BUNDLE_H */
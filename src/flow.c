@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+#include "flow.h"
+
+int flowClear(struct flowField *field)
+{
+  field->dist = field->buffers[0];
+  field->ready = field->buffers[1];
+  field->searching = 0;
+  field->hasReady = 0;
+  field->dirty = 1;
+  return 0;
+}
+
+// Solid tiles are unreachable, an open one is one more than the closest
+// neighbour. Called with i one tile in from the edge.
+static int patchTile(unsigned short *dist, int i, char solid)
+{
+  if (solid)
+  {
+    dist[i] = FLOWUNREACHED;
+    return 0;
+  }
+  int around[4] = { dist[i - FLOWSIZE], dist[i + FLOWSIZE], dist[i - 1], dist[i + 1] };
+  for (int k = 0; k < 4; ++k)
+    if (around[k] != FLOWUNREACHED && around[k] + 1 < dist[i])
+      dist[i] = around[k] + 1;
+  return 0;
+}
+
+int flowSetTile(struct flowField *field, struct tileCoord tile, char solid)
+{
+  field->dirty = 1;
+  // The search under way won't walk through a new wall. One that has
+  // already gone past an opened tile doesn't come back for it, the next
+  // search does.
+  unsigned int x = tile.x - field->originX, y = tile.y - field->originY;
+  if (field->searching && x < FLOWSIZE && y < FLOWSIZE)
+  {
+    field->solid[x * FLOWSIZE + y] = solid != 0;
+    if (solid)
+      field->dist[x * FLOWSIZE + y] = FLOWUNREACHED;
+  }
+  // Zombies go round it from now on
+  x = tile.x - field->readyOriginX;
+  y = tile.y - field->readyOriginY;
+  if (field->hasReady && x - 1 < FLOWSIZE - 2 && y - 1 < FLOWSIZE - 2)
+    patchTile(field->ready, x * FLOWSIZE + y, solid);
+  return 0;
+}
+
+// Set up a new search from the target with a fresh copy of the solid tiles
+static int flowRestart(struct flowField *field, const struct mapChunk *chunks[FLOWSIDE][FLOWSIDE], int originX, int originY, struct tileCoord target)
+{
+  field->originX = originX * CHUNKSIZE;
+  field->originY = originY * CHUNKSIZE;
+  field->targetX = target.x;
+  field->targetY = target.y;
+  field->dirty = 0;
+  field->searching = 1;
+  field->head = field->tail = 0;
+  // A chunk's tiles are columns of y, so each column copies straight across
+  for (int cx = 0; cx < FLOWSIDE; ++cx)
+    for (int cy = 0; cy < FLOWSIDE; ++cy)
+      for (int x = 0; x < CHUNKSIZE; ++x)
+      {
+        unsigned char *out = &field->solid[(cx * CHUNKSIZE + x) * FLOWSIZE + cy * CHUNKSIZE];
+        if (chunks[cy][cx])
+          memcpy(out, chunks[cy][cx]->tiles[x], CHUNKSIZE);
+        else
+          memset(out, 0, CHUNKSIZE);
+      }
+  memset(field->dist, 0xFF, sizeof(field->buffers[0]));
+
+  unsigned int x = target.x - field->originX, y = target.y - field->originY;
+  if (x < FLOWSIZE && y < FLOWSIZE)
+  {
+    field->dist[x * FLOWSIZE + y] = 0;
+    field->queue[field->tail++] = x * FLOWSIZE + y;
+  }
+  return 0;
+}
+
+int flowUpdate(struct flowField *field, const struct mapChunk *chunks[FLOWSIDE][FLOWSIDE], int originX, int originY, struct tileCoord target, int budget)
+{
+  // Only a new window makes the search under way no use, anything else
+  // waits for it to finish so there is always a field on its way
+  int windowMoved = field->originX != originX * CHUNKSIZE || field->originY != originY * CHUNKSIZE;
+  int targetMoved = field->targetX != target.x || field->targetY != target.y;
+  if (windowMoved || (!field->searching && (field->dirty || targetMoved || !field->hasReady)))
+    flowRestart(field, chunks, originX, originY, target);
+  if (!field->searching)
+    return 0;
+
+  unsigned short *dist = field->dist;
+  const unsigned char *solid = field->solid;
+  int *queue = field->queue;
+  int head = field->head, tail = field->tail;
+  for (int n = 0; n < budget && head < tail; ++n)
+  {
+    int i = queue[head++];
+    // Turned solid after it was reached
+    if (solid[i]) continue;
+    int x = i / FLOWSIZE, y = i % FLOWSIZE;
+    unsigned short d = dist[i] + 1;
+    // The four sides, skipping the ones off the edge of the field
+    int next[4] = { x > 0 ? i - FLOWSIZE : -1, x < FLOWSIZE - 1 ? i + FLOWSIZE : -1,
+                    y > 0 ? i - 1 : -1, y < FLOWSIZE - 1 ? i + 1 : -1 };
+    for (int k = 0; k < 4; ++k)
+    {
+      int j = next[k];
+      if (j == -1 || solid[j] || dist[j] != FLOWUNREACHED) continue;
+      dist[j] = d;
+      queue[tail++] = j;
+    }
+  }
+  field->head = head;
+  field->tail = tail;
+  if (head < tail)
+    return 0;
+
+  // Done, this becomes the field to follow
+  field->ready = dist;
+  field->dist = dist == field->buffers[0] ? field->buffers[1] : field->buffers[0];
+  field->readyOriginX = field->originX;
+  field->readyOriginY = field->originY;
+  field->readyTargetX = field->targetX;
+  field->readyTargetY = field->targetY;
+  field->hasReady = 1;
+  field->searching = 0;
+  return 1;
+}
+
+int flowWrite(const struct flowField *field, struct snapWriter *w)
+{
+  int numbers[12] = { field->originX, field->originY, field->targetX, field->targetY, field->searching, field->dirty,
+                      field->head, field->tail, field->readyOriginX, field->readyOriginY, field->readyTargetX, field->readyTargetY };
+  snapPut(w, numbers, sizeof(numbers));
+  snapPutU32(w, field->hasReady);
+  if (field->hasReady)
+    snapPut(w, field->ready, sizeof(field->buffers[0]));
+  // Only a search under way needs what it started from
+  if (field->searching)
+  {
+    snapPut(w, field->solid, sizeof(field->solid));
+    snapPut(w, field->dist, sizeof(field->buffers[0]));
+    // Tiles already taken off the queue aren't looked at again
+    snapPut(w, field->queue + field->head, sizeof(int) * (field->tail - field->head));
+  }
+  return w->failed ? -1 : 0;
+}
+
+int flowRead(struct flowField *field, struct snapReader *r)
+{
+  flowClear(field);
+  int numbers[12];
+  snapGet(r, numbers, sizeof(numbers));
+  field->originX = numbers[0];
+  field->originY = numbers[1];
+  field->targetX = numbers[2];
+  field->targetY = numbers[3];
+  field->searching = numbers[4];
+  field->dirty = numbers[5];
+  field->head = numbers[6];
+  field->tail = numbers[7];
+  field->readyOriginX = numbers[8];
+  field->readyOriginY = numbers[9];
+  field->readyTargetX = numbers[10];
+  field->readyTargetY = numbers[11];
+  field->hasReady = snapGetU32(r);
+  if (field->hasReady)
+    snapGet(r, field->ready, sizeof(field->buffers[0]));
+  if (field->searching)
+  {
+    if (field->head < 0 || field->head > field->tail || field->tail > FLOWSIZE * FLOWSIZE)
+      r->failed = 1;
+    snapGet(r, field->solid, sizeof(field->solid));
+    snapGet(r, field->dist, sizeof(field->buffers[0]));
+    if (!r->failed)
+      snapGet(r, field->queue + field->head, sizeof(int) * (field->tail - field->head));
+  }
+  if (r->failed)
+  {
+    flowClear(field);
+    return -1;
+  }
+  return 0;
+}
+
+Vector2 flowWaypoint(const struct flowField *field, Vector2 pos, Vector2 target)
+{
+  if (!field->hasReady)
+    return target;
+  struct tileCoord t = tileFromPos(pos);
+  unsigned int x = t.x - field->readyOriginX, y = t.y - field->readyOriginY;
+  // Stay one tile in from the edge so every neighbour is on the field
+  if (x - 1 >= FLOWSIZE - 2 || y - 1 >= FLOWSIZE - 2)
+    return target;
+  const unsigned short *dist = field->ready;
+  int i = x * FLOWSIZE + y;
+  // Next to the target (or somewhere walled off), just walk at it. The
+  // field leads to where the target was, as far from it as it has moved.
+  struct tileCoord now = tileFromPos(target);
+  int moved = abs(now.x - field->readyTargetX) + abs(now.y - field->readyTargetY);
+  if (dist[i] <= 1 + moved || dist[i] == FLOWUNREACHED)
+    return target;
+
+  int best = i;
+  for (int dx = -1; dx <= 1; ++dx)
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+      int j = i + dx * FLOWSIZE + dy;
+      if (dist[j] >= dist[best]) continue;
+      // No cutting across the corner of a solid tile
+      if (dx && dy && (dist[i + dx * FLOWSIZE] == FLOWUNREACHED || dist[i + dy] == FLOWUNREACHED)) continue;
+      best = j;
+    }
+  if (best == i)
+    return target;
+  return (Vector2){ field->readyOriginX + best / FLOWSIZE + 0.5f, field->readyOriginY + best % FLOWSIZE + 0.5f };
+}
@@ -0,0 +1,68 @@
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <raylib.h>
+#include "snapshot.h"
+#include "world.h"
+
+// The field covers this many chunks each way around the middle of the
+// active chunks, however far out those reach
+#define FLOWSIDE 3
+#define FLOWSIZE (FLOWSIDE * CHUNKSIZE)
+// Distance of a tile that is solid or can't be reached
+#define FLOWUNREACHED 0xFFFF
+
+// Walking distance in tiles from every tile of the FLOWSIDE chunks around
+// the middle of the active window to the target's tile, found with a
+// breadth first search. The search is spread over as many ticks as it takes
+// while the last finished field is used, so the work per tick is capped
+// however many zombies follow it. Tiles are indexed x * FLOWSIZE + y, the
+// same way round as a chunk's tiles.
+//
+// Only a new window throws a search away. When the target moves or a tile
+// changes the search carries on, and another starts as soon as it is done.
+// A changed tile is patched into both fields straight away, the tiles past
+// it catch up with the next search. A wider --view-radius doesn't widen the
+// field, zombies past it head straight for the target.
+struct flowField
+{
+  // The field being searched, or the last one when idle
+  int originX, originY; // World tile of index 0
+  int targetX, targetY;
+  int searching;
+  int dirty; // A tile changed since the search started, search again
+  unsigned short *dist;
+  int head, tail;
+  // The last finished field, what zombies follow
+  int readyOriginX, readyOriginY;
+  int readyTargetX, readyTargetY;
+  int hasReady;
+  unsigned short *ready;
+
+  unsigned char solid[FLOWSIZE * FLOWSIZE];
+  int queue[FLOWSIZE * FLOWSIZE];
+  unsigned short buffers[2][FLOWSIZE * FLOWSIZE];
+};
+
+// Forget both fields, for a new game
+int flowClear(struct flowField *field);
+// Call when a tile of an active chunk changes
+int flowSetTile(struct flowField *field, struct tileCoord tile, char solid);
+// Search up to budget more tiles. A new search starts over a new window
+// straight away, or once the last one is done if the target or a tile
+// changed since it started. chunks is laid out by position from the chunk
+// at (originX, originY), with NULL for chunks that aren't active.
+// Returns 1 when a new field was finished.
+int flowUpdate(struct flowField *field, const struct mapChunk *chunks[FLOWSIDE][FLOWSIDE], int originX, int originY, struct tileCoord target, int budget);
+// Write out both fields and how far the search has got, so a field read
+// back with flowRead finishes on the same tick it would have
+int flowWrite(const struct flowField *field, struct snapWriter *w);
+int flowRead(struct flowField *field, struct snapReader *r);
+// Where something at pos should head for next on its way to target: the
+// centre of the neighbouring tile closest to the target, or target itself
+// when it is close, off the field or can't be reached. The field may have
+// been found for where the target was a few tiles ago, that close it is
+// walked at directly too.
+Vector2 flowWaypoint(const struct flowField *field, Vector2 pos, Vector2 target);
+
+#endif /* FLOW_H */
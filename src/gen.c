@@ -0,0 +1,151 @@
+#include "gen.h"
+#include "jobs.h"
+#include "rng.h"
+
+#if defined(__SSE2__) && !defined(GEN_SCALAR)
+#include <emmintrin.h>
+#define GEN_SSE2
+#endif
+
+// Noise cells are this many tiles wide (as a shift), walls clump at the
+// fine scale and clearings at the coarse one
+#define WALLSHIFT 3
+#define CLEARINGSHIFT 5
+// A tile is a wall where the wall noise is above GENWALL, unless the
+// clearing noise is below GENCLEARING
+#define GENWALL 0.68f
+#define GENCLEARING 0.4f
+// Tiles this far from the origin either way are always open
+#define GENSTARTCLEAR 24
+// Rows handed to a thread at a time
+#define GENBATCH 16
+
+// A number from 0 up to 1 for a noise cell corner
+static float latticeValue(unsigned int seed, int stream, int x, int y)
+{
+  return (rngHash(seed, stream, x, y) >> 8) * (1.f / 16777216.f);
+}
+
+// Value noise along the row of world tile x from tile y0, CHUNKSIZE long.
+// Across the row the corners are blended once per cell, along it each cell
+// is the same curve scaled, which is done 4 tiles at a time.
+static int noiseRow(float *out, unsigned int seed, int stream, int x, int y0, int shift)
+{
+  int cell = 1 << shift;
+  int cells = CHUNKSIZE >> shift;
+  float weights[1 << CLEARINGSHIFT];
+  for (int i = 0; i < cell; ++i)
+  {
+    float t = (float) i / cell;
+    weights[i] = t * t * (3.f - 2.f * t);
+  }
+  float t = (float)(x & (cell - 1)) / cell;
+  float across = t * t * (3.f - 2.f * t);
+  int cx = x >> shift, cy = y0 >> shift;
+  float edges[(CHUNKSIZE >> WALLSHIFT) + 1];
+  for (int j = 0; j <= cells; ++j)
+  {
+    float a = latticeValue(seed, stream, cx, cy + j);
+    float b = latticeValue(seed, stream, cx + 1, cy + j);
+    edges[j] = a + (b - a) * across;
+  }
+  for (int j = 0; j < cells; ++j)
+  {
+    float a = edges[j], d = edges[j + 1] - edges[j];
+    float *o = out + j * cell;
+#ifdef GEN_SSE2
+    __m128 va = _mm_set1_ps(a), vd = _mm_set1_ps(d);
+    for (int i = 0; i < cell; i += 4)
+      _mm_storeu_ps(o + i, _mm_add_ps(va, _mm_mul_ps(vd, _mm_loadu_ps(weights + i))));
+#else
+    for (int i = 0; i < cell; ++i)
+      o[i] = a + d * weights[i];
+#endif
+  }
+  return 0;
+}
+
+// Walls where both noises say so, 16 tiles at a time
+static int wallRow(char *row, const float *wall, const float *clearing)
+{
+#ifdef GEN_SSE2
+  __m128 wallLevel = _mm_set1_ps(GENWALL), clearingLevel = _mm_set1_ps(GENCLEARING);
+  __m128i one = _mm_set1_epi32(1);
+  for (int y = 0; y < CHUNKSIZE; y += 16)
+  {
+    __m128i solid[4];
+    for (int k = 0; k < 4; ++k)
+    {
+      __m128 m = _mm_and_ps(_mm_cmpgt_ps(_mm_loadu_ps(wall + y + 4 * k), wallLevel),
+                            _mm_cmpge_ps(_mm_loadu_ps(clearing + y + 4 * k), clearingLevel));
+      solid[k] = _mm_and_si128(_mm_castps_si128(m), one);
+    }
+    __m128i bytes = _mm_packus_epi16(_mm_packs_epi32(solid[0], solid[1]), _mm_packs_epi32(solid[2], solid[3]));
+    _mm_storeu_si128((__m128i *)(row + y), bytes);
+  }
+#else
+  for (int y = 0; y < CHUNKSIZE; ++y)
+    row[y] = wall[y] > GENWALL && clearing[y] >= GENCLEARING;
+#endif
+  return 0;
+}
+
+// Open up the tiles of row x (world coordinates, the row starts at y0) that
+// are within radius of (cx, cy) either way
+static int clearSquare(char *row, int x, int y0, int cx, int cy, int radius)
+{
+  if (x < cx - radius || x > cx + radius)
+    return 0;
+  for (int y = cy - radius; y <= cy + radius; ++y)
+    if (y >= y0 && y < y0 + CHUNKSIZE)
+      row[y - y0] = 0;
+  return 0;
+}
+
+struct genJob
+{
+  struct mapChunk **chunks;
+  unsigned int seed;
+};
+
+// Rows are numbered through every chunk, CHUNKSIZE to a chunk
+static int genBatch(int begin, int end, void *user)
+{
+  struct genJob *job = user;
+  float wall[CHUNKSIZE], clearing[CHUNKSIZE];
+  for (int r = begin; r < end; ++r)
+  {
+    struct mapChunk *chunk = job->chunks[r / CHUNKSIZE];
+    int local = r % CHUNKSIZE;
+    int x = CHUNKSIZE * (int) chunk->pos.x + local;
+    int y0 = CHUNKSIZE * (int) chunk->pos.y;
+    noiseRow(wall, job->seed, RNGSTREAM_WALLS, x, y0, WALLSHIFT);
+    noiseRow(clearing, job->seed, RNGSTREAM_CLEARINGS, x, y0, CLEARINGSHIFT);
+    wallRow(chunk->tiles[local], wall, clearing);
+    clearSquare(chunk->tiles[local], x, y0, 0, 0, GENSTARTCLEAR);
+    struct tileCoord spawns[GENSPAWNS];
+    genSpawnPoints(job->seed, (int) chunk->pos.x, (int) chunk->pos.y, spawns);
+    for (int s = 0; s < GENSPAWNS; ++s)
+      clearSquare(chunk->tiles[local], x, y0, spawns[s].x, spawns[s].y, 1);
+  }
+  return 0;
+}
+
+int genChunks(struct mapChunk *chunks[], int count, unsigned int seed)
+{
+  struct genJob job = { chunks, seed };
+  for (int c = 0; c < count; ++c)
+    chunks[c]->edited = 0;
+  return jobsRun(count * CHUNKSIZE, GENBATCH, genBatch, &job);
+}
+
+int genSpawnPoints(unsigned int seed, int x, int y, struct tileCoord out[GENSPAWNS])
+{
+  for (int s = 0; s < GENSPAWNS; ++s)
+  {
+    unsigned int h = rngHash(seed, RNGSTREAM_SPAWNPOINTS, x * GENSPAWNS + s, y);
+    out[s].x = CHUNKSIZE * x + (int)(h & CHUNKMASK);
+    out[s].y = CHUNKSIZE * y + (int)((h >> CHUNKSHIFT) & CHUNKMASK);
+  }
+  return 0;
+}
@@ -0,0 +1,19 @@
+#ifndef GEN_H
+#define GEN_H
+
+#include "world.h"
+
+// Spawn points the generator keeps open in each chunk
+#define GENSPAWNS 4
+
+// Fill in chunks' tiles from the seed and their chunk coordinates: walls in
+// clumps, clearings with none, and open ground around the world origin
+// where every game starts. The rows are shared out over the job pool. The
+// same seed and coordinates always give the same tiles, so a chunk nobody
+// changed can be made again instead of kept.
+int genChunks(struct mapChunk *chunks[], int count, unsigned int seed);
+// The world tiles of chunk (x, y) that zombies can come out of, open ground
+// unless someone built over them since
+int genSpawnPoints(unsigned int seed, int x, int y, struct tileCoord out[GENSPAWNS]);
+
+#endif /* GEN_H */
@@ -0,0 +1,89 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "grid.h"
+
+static int gridBucket(const struct spatialGrid *grid, int cx, int cy)
+{
+  unsigned int h = (unsigned int) cx * 73856093u ^ (unsigned int) cy * 19349663u;
+  return (int)(h & (unsigned int) grid->tableMask);
+}
+
+int gridInit(struct spatialGrid *grid, float cellSize, int capacity)
+{
+  // Keep the table at least twice the entity count so buckets stay short
+  int tableSize = 64;
+  while (tableSize < capacity * 2)
+    tableSize <<= 1;
+  grid->cellSize = cellSize;
+  grid->invCellSize = 1.f / cellSize;
+  grid->tableMask = tableSize - 1;
+  grid->cellStart = malloc(sizeof(int) * (tableSize + 1));
+  grid->items = malloc(sizeof(int) * capacity);
+  grid->capacity = capacity;
+  grid->count = 0;
+  if (!grid->cellStart || !grid->items)
+  {
+    gridFree(grid);
+    return -1;
+  }
+  return 0;
+}
+
+int gridFree(struct spatialGrid *grid)
+{
+  free(grid->cellStart);
+  free(grid->items);
+  grid->cellStart = NULL;
+  grid->items = NULL;
+  grid->capacity = 0;
+  grid->count = 0;
+  return 0;
+}
+
+int gridBuild(struct spatialGrid *grid, int length, const float x[length], const float y[length])
+{
+  int tableSize = grid->tableMask + 1;
+  int *start = grid->cellStart;
+  if (length > grid->capacity) length = grid->capacity;
+
+  // Counting sort by bucket: count, prefix sum, then scatter
+  memset(start, 0, sizeof(int) * (tableSize + 1));
+  for (int i = 0; i < length; ++i)
+  {
+    int b = gridBucket(grid, (int) floorf(x[i] * grid->invCellSize), (int) floorf(y[i] * grid->invCellSize));
+    start[b + 1]++;
+  }
+  for (int b = 0; b < tableSize; ++b)
+    start[b + 1] += start[b];
+  grid->count = start[tableSize];
+
+  // Scatter using the end of the previous bucket as a cursor, which leaves
+  // start[b] pointing at the end of bucket b, so shift everything back after
+  for (int i = 0; i < length; ++i)
+  {
+    int b = gridBucket(grid, (int) floorf(x[i] * grid->invCellSize), (int) floorf(y[i] * grid->invCellSize));
+    grid->items[start[b]++] = i;
+  }
+  memmove(start + 1, start, sizeof(int) * tableSize);
+  start[0] = 0;
+  return 0;
+}
+
+int gridNeighbours(const struct spatialGrid *grid, float x, float y, int buckets[9])
+{
+  int cx = (int) floorf(x * grid->invCellSize);
+  int cy = (int) floorf(y * grid->invCellSize);
+  int n = 0;
+  for (int dx = -1; dx <= 1; ++dx)
+    for (int dy = -1; dy <= 1; ++dy)
+    {
+      // Two cells can hash to the same bucket, only visit it once
+      int b = gridBucket(grid, cx + dx, cy + dy);
+      int seen = 0;
+      for (int k = 0; k < n; ++k)
+        if (buckets[k] == b) seen = 1;
+      if (!seen) buckets[n++] = b;
+    }
+  return n;
+}
@@ -0,0 +1,25 @@
+#ifndef GRID_H
+#define GRID_H
+
+// Uniform grid for neighbour queries. Cells are hashed into a fixed size
+// table so the world does not need bounds, collisions in the table only
+// cost a few extra distance checks.
+struct spatialGrid
+{
+  float cellSize;
+  float invCellSize;
+  int tableMask;  // Table size - 1, table size is a power of two
+  int *cellStart; // Start of each bucket in items, tableMask + 2 entries
+  int *items;     // Entity indices sorted by bucket
+  int capacity;
+  int count;
+};
+
+int gridInit(struct spatialGrid *grid, float cellSize, int capacity);
+int gridFree(struct spatialGrid *grid);
+// Rebuild the grid from scratch
+int gridBuild(struct spatialGrid *grid, int length, const float x[length], const float y[length]);
+// Get the distinct buckets covering the 3x3 cells around (x, y), returns how many
+int gridNeighbours(const struct spatialGrid *grid, float x, float y, int buckets[9]);
+
+#endif /* GRID_H */
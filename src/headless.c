@@ -0,0 +1,89 @@
+#define _POSIX_C_SOURCE 199309L
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <time.h>
+#include "headless.h"
+
+double clockSeconds()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int statsInit(struct tickStats *stats, int capacity)
+{
+  stats->times = malloc(sizeof(double) * capacity);
+  stats->count = 0;
+  stats->capacity = stats->times ? capacity : 0;
+  stats->total = 0;
+  stats->sorted = 0;
+  return stats->times ? 0 : -1;
+}
+
+int statsFree(struct tickStats *stats)
+{
+  free(stats->times);
+  stats->times = NULL;
+  stats->capacity = 0;
+  return 0;
+}
+
+int statsAdd(struct tickStats *stats, double seconds)
+{
+  if (stats->count < stats->capacity)
+    stats->times[stats->count++] = seconds;
+  stats->total += seconds;
+  return 0;
+}
+
+static int compareDouble(const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+double statsPercentile(struct tickStats *stats, double p)
+{
+  if (!stats->count)
+    return 0;
+  // Sorting scrambles the order, only do this once the run is over
+  if (!stats->sorted)
+    qsort(stats->times, stats->count, sizeof(double), compareDouble);
+  stats->sorted = 1;
+  int i = stats->count * p;
+  return stats->times[i < stats->count ? i : stats->count - 1];
+}
+
+int statsReport(struct tickStats *stats, FILE *out)
+{
+  if (!stats->count)
+  {
+    fprintf(out, "No ticks were run\n");
+    return -1;
+  }
+  double p50 = statsPercentile(stats, 0.5);
+  double p99 = statsPercentile(stats, 0.99);
+  double max = statsPercentile(stats, 1);
+  fprintf(out, "ticks/sec: %.1f\n", stats->count / stats->total);
+  fprintf(out, "tick time: p50 %.4f ms, p99 %.4f ms, max %.4f ms\n", p50 * 1000, p99 * 1000, max * 1000);
+  return 0;
+}
+
+int statsJson(struct tickStats *stats, FILE *out)
+{
+  fprintf(out, "{ \"count\": %d, \"per_sec\": %.1f, \"p50_ms\": %.4f, \"p90_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f }",
+    stats->count, stats->total > 0 ? stats->count / stats->total : 0,
+    statsPercentile(stats, 0.5) * 1000, statsPercentile(stats, 0.9) * 1000,
+    statsPercentile(stats, 0.99) * 1000, statsPercentile(stats, 1) * 1000);
+  return 0;
+}
+
+long peakRssKb()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage))
+    return -1;
+  // Linux counts this in kilobytes
+  return usage.ru_maxrss;
+}
@@ -0,0 +1,30 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <stdio.h>
+
+// Per tick timings collected while running the simulation without a window
+struct tickStats
+{
+  double *times; // Seconds taken by each tick
+  int count;
+  int capacity;
+  double total;
+  int sorted; // times is in order, not in the order the ticks ran
+};
+
+// Monotonic clock in seconds
+double clockSeconds();
+int statsInit(struct tickStats *stats, int capacity);
+int statsFree(struct tickStats *stats);
+int statsAdd(struct tickStats *stats, double seconds);
+// Time taken by the tick fraction p (0-1) of the way from fastest to slowest
+double statsPercentile(struct tickStats *stats, double p);
+// Print ticks/sec and p50/p99/max tick time
+int statsReport(struct tickStats *stats, FILE *out);
+// Write count, per second and p50/p90/p99/max in milliseconds as a JSON object
+int statsJson(struct tickStats *stats, FILE *out);
+// Most memory this process has had resident, in kilobytes
+long peakRssKb();
+
+#endif /* HEADLESS_H */
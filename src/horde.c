@@ -0,0 +1,378 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "horde.h"
+
+#if defined(__AVX2__) && !defined(HORDE_SCALAR)
+#include <immintrin.h>
+#define HORDE_AVX2
+#elif defined(__SSE2__) && !defined(HORDE_SCALAR)
+#include <emmintrin.h>
+#define HORDE_SSE2
+#endif
+
+// Smallest distance used when dividing, stops a zombie standing exactly on
+// the target from turning into NaN
+#define MINDISTANCE 1e-6f
+
+int hordeInit(struct horde *h, int capacity)
+{
+  memset(h, 0, sizeof(*h));
+  if (capacity > HORDELIMIT)
+    return -1;
+  float **floats[] = { &h->x, &h->y, &h->prevX, &h->prevY, &h->nextX, &h->nextY, &h->goalX, &h->goalY };
+  int fail = 0;
+  for (unsigned int i = 0; i < sizeof(floats) / sizeof(floats[0]); ++i)
+    fail |= !(*floats[i] = malloc(sizeof(float) * capacity));
+  int **ints[] = { &h->handle, &h->slotIndex, &h->slotReuse, &h->freeSlots, &h->sortedHandle };
+  for (unsigned int i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i)
+    fail |= !(*ints[i] = malloc(sizeof(int) * capacity));
+  fail |= !(h->band = malloc(capacity));
+  if (fail)
+  {
+    hordeFree(h);
+    return -1;
+  }
+  h->capacity = capacity;
+  return hordeClear(h);
+}
+
+int hordeFree(struct horde *h)
+{
+  float **floats[] = { &h->x, &h->y, &h->prevX, &h->prevY, &h->nextX, &h->nextY, &h->goalX, &h->goalY };
+  for (unsigned int i = 0; i < sizeof(floats) / sizeof(floats[0]); ++i)
+    free(*floats[i]);
+  free(h->handle);
+  free(h->slotIndex);
+  free(h->slotReuse);
+  free(h->freeSlots);
+  free(h->band);
+  free(h->sortedHandle);
+  memset(h, 0, sizeof(*h));
+  return 0;
+}
+
+int hordeClear(struct horde *h)
+{
+  h->count = 0;
+  h->freeCount = h->capacity;
+  for (int s = 0; s < h->capacity; ++s)
+  {
+    h->slotIndex[s] = -1;
+    h->slotReuse[s] = 0;
+    // Hand out slot 0 first
+    h->freeSlots[h->capacity - 1 - s] = s;
+  }
+  return 0;
+}
+
+int hordeSpawn(struct horde *h, Vector2 pos)
+{
+  if (h->count == h->capacity)
+    return -1;
+  int i = h->count++;
+  int slot = h->freeSlots[--h->freeCount];
+  h->slotIndex[slot] = i;
+  h->handle[i] = slot | h->slotReuse[slot] << HANDLESLOTBITS;
+  h->x[i] = pos.x;
+  h->y[i] = pos.y;
+  // Don't slide in from wherever the index was last used
+  h->prevX[i] = pos.x;
+  h->prevY[i] = pos.y;
+  h->goalX[i] = pos.x;
+  h->goalY[i] = pos.y;
+  return h->handle[i];
+}
+
+int hordeKill(struct horde *h, int index)
+{
+  int slot = h->handle[index] & HANDLESLOTMASK;
+  h->slotIndex[slot] = -1;
+  // Only the bits above the slot are kept, and they stay positive
+  h->slotReuse[slot] = (h->slotReuse[slot] + 1) & HANDLEREUSEMASK;
+  h->freeSlots[h->freeCount++] = slot;
+
+  int last = --h->count;
+  if (index != last)
+  {
+    h->x[index] = h->x[last];
+    h->y[index] = h->y[last];
+    h->prevX[index] = h->prevX[last];
+    h->prevY[index] = h->prevY[last];
+    h->goalX[index] = h->goalX[last];
+    h->goalY[index] = h->goalY[last];
+    h->handle[index] = h->handle[last];
+    h->slotIndex[h->handle[index] & HANDLESLOTMASK] = index;
+  }
+  return 0;
+}
+
+int hordeWrite(const struct horde *h, struct snapWriter *w)
+{
+  snapPutU32(w, h->capacity);
+  snapPutU32(w, h->count);
+  // Goals and next positions are worked out fresh every tick
+  const float *floats[] = { h->x, h->y, h->prevX, h->prevY };
+  for (unsigned int i = 0; i < sizeof(floats) / sizeof(floats[0]); ++i)
+    snapPut(w, floats[i], sizeof(float) * h->count);
+  snapPut(w, h->handle, sizeof(int) * h->count);
+  snapPut(w, h->slotReuse, sizeof(int) * h->capacity);
+  snapPutU32(w, h->freeCount);
+  snapPut(w, h->freeSlots, sizeof(int) * h->freeCount);
+  return w->failed ? -1 : 0;
+}
+
+int hordeRead(struct horde *h, struct snapReader *r)
+{
+  if ((int) snapGetU32(r) != h->capacity)
+    return -1;
+  int count = snapGetU32(r);
+  if (count < 0 || count > h->capacity)
+    return -1;
+  h->count = count;
+  float *floats[] = { h->x, h->y, h->prevX, h->prevY };
+  for (unsigned int i = 0; i < sizeof(floats) / sizeof(floats[0]); ++i)
+    snapGet(r, floats[i], sizeof(float) * count);
+  memcpy(h->goalX, h->x, sizeof(float) * count);
+  memcpy(h->goalY, h->y, sizeof(float) * count);
+  snapGet(r, h->handle, sizeof(int) * count);
+  snapGet(r, h->slotReuse, sizeof(int) * h->capacity);
+  h->freeCount = snapGetU32(r);
+  if (h->freeCount < 0 || h->freeCount > h->capacity)
+    r->failed = 1;
+  else
+    snapGet(r, h->freeSlots, sizeof(int) * h->freeCount);
+  if (r->failed)
+  {
+    hordeClear(h);
+    return -1;
+  }
+  for (int s = 0; s < h->capacity; ++s)
+    h->slotIndex[s] = -1;
+  for (int i = 0; i < count; ++i)
+    h->slotIndex[h->handle[i] & HANDLESLOTMASK] = i;
+  return 0;
+}
+
+int hordeFind(const struct horde *h, int handle)
+{
+  if (handle < 0) return -1;
+  int slot = handle & HANDLESLOTMASK;
+  if (slot >= h->capacity) return -1;
+  int i = h->slotIndex[slot];
+  if (i == -1 || h->handle[i] != handle) return -1;
+  return i;
+}
+
+int hordeSetGoal(struct horde *h, int index, Vector2 goal)
+{
+  h->goalX[index] = goal.x;
+  h->goalY[index] = goal.y;
+  return 0;
+}
+
+int hordeSnapshot(struct horde *h)
+{
+  memcpy(h->prevX, h->x, sizeof(float) * h->count);
+  memcpy(h->prevY, h->y, sizeof(float) * h->count);
+  return 0;
+}
+
+Vector2 hordeLerpPos(const struct horde *h, int index, float alpha)
+{
+  return (Vector2){
+    h->prevX[index] + alpha * (h->x[index] - h->prevX[index]),
+    h->prevY[index] + alpha * (h->y[index] - h->prevY[index]),
+  };
+}
+
+const char *hordeKernelName()
+{
+#if defined(HORDE_AVX2)
+  return "avx2";
+#elif defined(HORDE_SSE2)
+  return "sse2";
+#else
+  return "scalar";
+#endif
+}
+
+// Scalar version of one chase step, also used for the tails of the SIMD loops
+static int chaseOne(struct horde *h, int i, float tx, float ty, float step, float catchRadius)
+{
+  float cx = tx - h->x[i];
+  float cy = ty - h->y[i];
+  float dx = h->goalX[i] - h->x[i];
+  float dy = h->goalY[i] - h->y[i];
+  float d = sqrtf(dx * dx + dy * dy);
+  float t = step / (d > MINDISTANCE ? d : MINDISTANCE);
+  h->x[i] = h->x[i] + t * dx;
+  h->y[i] = h->y[i] + t * dy;
+  return cx * cx + cy * cy < catchRadius * catchRadius;
+}
+
+int hordeChaseRange(struct horde *h, int begin, int end, Vector2 target, float step, float catchRadius)
+{
+  int caught = 0;
+  int i = begin;
+#if defined(HORDE_AVX2)
+  const __m256 tx = _mm256_set1_ps(target.x), ty = _mm256_set1_ps(target.y);
+  const __m256 vstep = _mm256_set1_ps(step), vcatch2 = _mm256_set1_ps(catchRadius * catchRadius);
+  const __m256 vmin = _mm256_set1_ps(MINDISTANCE);
+  for (; i + 8 <= end; i += 8)
+  {
+    __m256 x = _mm256_loadu_ps(&h->x[i]), y = _mm256_loadu_ps(&h->y[i]);
+    __m256 cx = _mm256_sub_ps(tx, x), cy = _mm256_sub_ps(ty, y);
+    __m256 c2 = _mm256_add_ps(_mm256_mul_ps(cx, cx), _mm256_mul_ps(cy, cy));
+    caught |= _mm256_movemask_ps(_mm256_cmp_ps(c2, vcatch2, _CMP_LT_OQ));
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&h->goalX[i]), x);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&h->goalY[i]), y);
+    __m256 d = _mm256_sqrt_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)));
+    __m256 t = _mm256_div_ps(vstep, _mm256_max_ps(d, vmin));
+    _mm256_storeu_ps(&h->x[i], _mm256_add_ps(x, _mm256_mul_ps(t, dx)));
+    _mm256_storeu_ps(&h->y[i], _mm256_add_ps(y, _mm256_mul_ps(t, dy)));
+  }
+#elif defined(HORDE_SSE2)
+  const __m128 tx = _mm_set1_ps(target.x), ty = _mm_set1_ps(target.y);
+  const __m128 vstep = _mm_set1_ps(step), vcatch2 = _mm_set1_ps(catchRadius * catchRadius);
+  const __m128 vmin = _mm_set1_ps(MINDISTANCE);
+  for (; i + 4 <= end; i += 4)
+  {
+    __m128 x = _mm_loadu_ps(&h->x[i]), y = _mm_loadu_ps(&h->y[i]);
+    __m128 cx = _mm_sub_ps(tx, x), cy = _mm_sub_ps(ty, y);
+    __m128 c2 = _mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy));
+    caught |= _mm_movemask_ps(_mm_cmplt_ps(c2, vcatch2));
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(&h->goalX[i]), x);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(&h->goalY[i]), y);
+    __m128 d = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)));
+    __m128 t = _mm_div_ps(vstep, _mm_max_ps(d, vmin));
+    _mm_storeu_ps(&h->x[i], _mm_add_ps(x, _mm_mul_ps(t, dx)));
+    _mm_storeu_ps(&h->y[i], _mm_add_ps(y, _mm_mul_ps(t, dy)));
+  }
+#endif
+  for (; i < end; ++i)
+    caught |= chaseOne(h, i, target.x, target.y, step, catchRadius);
+  return caught != 0;
+}
+
+int hordeSeparate(struct horde *h, const struct spatialGrid *grid, float radius, int begin, int end)
+{
+  int buckets[9];
+  for (int i = begin; i < end; ++i)
+  {
+    float x = h->x[i], y = h->y[i];
+    int nBuckets = gridNeighbours(grid, h->x[i], h->y[i], buckets);
+    for (int b = 0; b < nBuckets; ++b)
+      for (int k = grid->cellStart[buckets[b]]; k < grid->cellStart[buckets[b] + 1]; ++k)
+      {
+        int j = grid->items[k];
+        if (i == j) continue;
+        float xSep = h->x[i] - h->x[j];
+        float ySep = h->y[i] - h->y[j];
+        if (xSep > 0.15 || xSep < -0.15 || ySep > 0.15 || xSep < -0.15) continue;
+        if (xSep * xSep + ySep * ySep > radius * radius) continue;
+        // Mirror the zombie away from the one it is touching
+        x += xSep;
+        y += ySep;
+      }
+    h->nextX[i] = x;
+    h->nextY[i] = y;
+  }
+  return 0;
+}
+
+int hordeCommitRange(struct horde *h, int begin, int end)
+{
+  memcpy(h->x + begin, h->nextX + begin, sizeof(float) * (end - begin));
+  memcpy(h->y + begin, h->nextY + begin, sizeof(float) * (end - begin));
+  return 0;
+}
+
+int hordeSortBands(struct horde *h, Vector2 centre, const float radius[], int bands, int ends[])
+{
+  int counts[HORDEMAXBANDS] = { 0 };
+  int sorted = 1;
+  for (int i = 0; i < h->count; ++i)
+  {
+    float dx = h->x[i] - centre.x, dy = h->y[i] - centre.y;
+    float d2 = dx * dx + dy * dy;
+    int b = 0;
+    while (b < bands - 1 && d2 >= radius[b] * radius[b])
+      b++;
+    h->band[i] = b;
+    counts[b]++;
+    sorted &= !i || h->band[i - 1] <= b;
+  }
+  int starts[HORDEMAXBANDS];
+  for (int b = 0, at = 0; b < bands; ++b)
+  {
+    starts[b] = at;
+    at += counts[b];
+    ends[b] = at;
+  }
+  // Zombies mostly stay in their band, then nothing has to move
+  if (sorted)
+    return 0;
+
+  // A counting sort, each array goes through nextX and swaps with it
+  float **floats[] = { &h->x, &h->y, &h->prevX, &h->prevY, &h->goalX, &h->goalY };
+  int next[HORDEMAXBANDS];
+  for (unsigned int k = 0; k < sizeof(floats) / sizeof(floats[0]); ++k)
+  {
+    float *in = *floats[k], *out = h->nextX;
+    memcpy(next, starts, sizeof(int) * bands);
+    for (int i = 0; i < h->count; ++i)
+      out[next[h->band[i]]++] = in[i];
+    h->nextX = in;
+    *floats[k] = out;
+  }
+  memcpy(next, starts, sizeof(int) * bands);
+  for (int i = 0; i < h->count; ++i)
+    h->sortedHandle[next[h->band[i]]++] = h->handle[i];
+  int *t = h->handle;
+  h->handle = h->sortedHandle;
+  h->sortedHandle = t;
+  for (int i = 0; i < h->count; ++i)
+    h->slotIndex[h->handle[i] & HANDLESLOTMASK] = i;
+  return 0;
+}
+
+int hordeInRange(const struct horde *h, Vector2 centre, float radius, int out[])
+{
+  int n = 0;
+  int i = 0;
+  float r2 = radius * radius;
+#if defined(HORDE_AVX2)
+  const __m256 cx = _mm256_set1_ps(centre.x), cy = _mm256_set1_ps(centre.y);
+  const __m256 vr2 = _mm256_set1_ps(r2);
+  for (; i + 8 <= h->count; i += 8)
+  {
+    __m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&h->x[i]), cx);
+    __m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&h->y[i]), cy);
+    __m256 d2 = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+    int mask = _mm256_movemask_ps(_mm256_cmp_ps(d2, vr2, _CMP_LE_OQ));
+    for (; mask; mask &= mask - 1)
+      out[n++] = i + __builtin_ctz(mask);
+  }
+#elif defined(HORDE_SSE2)
+  const __m128 cx = _mm_set1_ps(centre.x), cy = _mm_set1_ps(centre.y);
+  const __m128 vr2 = _mm_set1_ps(r2);
+  for (; i + 4 <= h->count; i += 4)
+  {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(&h->x[i]), cx);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(&h->y[i]), cy);
+    __m128 d2 = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+    int mask = _mm_movemask_ps(_mm_cmple_ps(d2, vr2));
+    for (; mask; mask &= mask - 1)
+      out[n++] = i + __builtin_ctz(mask);
+  }
+#endif
+  for (; i < h->count; ++i)
+  {
+    float dx = h->x[i] - centre.x;
+    float dy = h->y[i] - centre.y;
+    if (dx * dx + dy * dy <= r2)
+      out[n++] = i;
+  }
+  return n;
+}
@@ -0,0 +1,95 @@
+#ifndef HORDE_H
+#define HORDE_H
+
+#include <raylib.h>
+#include "grid.h"
+#include "snapshot.h"
+
+// Handles keep the slot in the low bits and a count of how often the slot
+// was reused above them, so a handle to a dead zombie doesn't find the next
+// one in its slot (until the count wraps after 512 reuses)
+#define HANDLESLOTBITS 22
+#define HANDLESLOTMASK ((1 << HANDLESLOTBITS) - 1)
+#define HANDLEREUSEMASK ((1 << (31 - HANDLESLOTBITS)) - 1)
+// Most zombies a horde can hold, so the slot fits in a handle
+#define HORDELIMIT (1 << HANDLESLOTBITS)
+// Most distance bands hordeSortBands sorts into
+#define HORDEMAXBANDS 8
+
+// Live zombies packed at the front of separate x and y arrays, so the hot
+// loops only visit live zombies and can work on several at once. A zombie
+// that dies is replaced by the last one, which changes its index, so
+// anything that keeps a zombie across ticks should keep its handle.
+struct horde
+{
+  int count;
+  int capacity;
+  float *x;
+  float *y;
+  // Positions at the start of the tick, for drawing between ticks
+  float *prevX;
+  float *prevY;
+  // Positions being worked out, so every zombie reads where the others
+  // were and not where some of them have already moved to
+  float *nextX;
+  float *nextY;
+  // Where each zombie walks towards this tick, on its way to the target
+  float *goalX;
+  float *goalY;
+  int *handle; // Handle of the zombie at each index
+  // For each handle slot, the index of its zombie or -1 if unused
+  int *slotIndex;
+  int *slotReuse;
+  int *freeSlots;
+  int freeCount;
+  // For hordeSortBands, each zombie's band and the handles being moved
+  unsigned char *band;
+  int *sortedHandle;
+};
+
+// capacity is set once for a game (--zombie-capacity), spawns stop when the
+// horde is full
+int hordeInit(struct horde *h, int capacity);
+int hordeFree(struct horde *h);
+// Remove every zombie
+int hordeClear(struct horde *h);
+// Add a zombie, returns its handle or -1 if the horde is full
+int hordeSpawn(struct horde *h, Vector2 pos);
+// Remove the zombie at index, the last zombie takes its place
+int hordeKill(struct horde *h, int index);
+// Index of the zombie with the given handle, -1 if it has died
+int hordeFind(const struct horde *h, int handle);
+int hordeSetGoal(struct horde *h, int index, Vector2 goal);
+// Remember the current positions as the previous ones, call before a tick
+int hordeSnapshot(struct horde *h);
+// Position of a zombie alpha of the way from the previous tick to this one
+Vector2 hordeLerpPos(const struct horde *h, int index, float alpha);
+// Move the zombies from begin up to end step tiles towards their goals.
+// Returns 1 if any of them was within catchRadius of the target before
+// moving.
+int hordeChaseRange(struct horde *h, int begin, int end, Vector2 target, float step, float catchRadius);
+// Work out where the indices from begin up to end go when pushed apart from
+// the zombies within radius of them, into nextX and nextY. grid has to be
+// built from the current positions.
+int hordeSeparate(struct horde *h, const struct spatialGrid *grid, float radius, int begin, int end);
+// Make the positions in nextX and nextY the current ones for the indices
+// from begin up to end, the rest stay put
+int hordeCommitRange(struct horde *h, int begin, int end);
+// Sort the zombies into bands by distance from centre: band b holds the
+// ones closer than radius[b] that aren't in an earlier band, and the last
+// band the rest (radius has bands - 1 entries). Zombies keep their order
+// within a band. ends[b] is one past the last index in band b.
+int hordeSortBands(struct horde *h, Vector2 centre, const float radius[], int bands, int ends[]);
+// Write the indices of all zombies within radius of centre to out (count
+// entries), returns how many were found
+int hordeInRange(const struct horde *h, Vector2 centre, float radius, int out[]);
+// Write out every zombie and the handles in use, enough for hordeRead to
+// carry on exactly where this horde is
+int hordeWrite(const struct horde *h, struct snapWriter *w);
+// Replace the zombies with ones from hordeWrite. The horde has to have the
+// capacity it was written with, returns -1 if not or if r runs short.
+int hordeRead(struct horde *h, struct snapReader *r);
+// Name of the kernel set compiled in (avx2, sse2 or scalar)
+const char *hordeKernelName();
+
+#endif /* HORDE_H */
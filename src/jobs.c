@@ -0,0 +1,121 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <unistd.h>
+#include "jobs.h"
+
+static pthread_t workers[MAXTHREADS];
+static int workerCount;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+// Held by the thread whose job is running
+static pthread_mutex_t owner = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wake = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done = PTHREAD_COND_INITIALIZER;
+
+// The job being run, only changed while no worker is busy with it
+static jobFunc jobFn;
+static void *jobUser;
+static int jobCount, jobBatch, jobBatches;
+static unsigned long generation;
+static int quit;
+// Next batch to hand out, and workers still between waking and finishing
+static int nextBatch;
+static int busy;
+
+// Take batches until there are none left
+static int runBatches()
+{
+  int b;
+  while ((b = __atomic_fetch_add(&nextBatch, 1, __ATOMIC_RELAXED)) < jobBatches)
+  {
+    int begin = b * jobBatch;
+    int end = begin + jobBatch < jobCount ? begin + jobBatch : jobCount;
+    jobFn(begin, end, jobUser);
+  }
+  return 0;
+}
+
+static void *workerMain(void *arg)
+{
+  (void) arg;
+  unsigned long seen = 0;
+  pthread_mutex_lock(&lock);
+  for (;;)
+  {
+    while (generation == seen && !quit)
+      pthread_cond_wait(&wake, &lock);
+    if (quit) break;
+    seen = generation;
+    busy++;
+    pthread_mutex_unlock(&lock);
+    runBatches();
+    pthread_mutex_lock(&lock);
+    if (--busy == 0)
+      pthread_cond_signal(&done);
+  }
+  pthread_mutex_unlock(&lock);
+  return NULL;
+}
+
+int jobsInit(int threads)
+{
+  if (threads <= 0)
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (threads < 1) threads = 1;
+  if (threads > MAXTHREADS) threads = MAXTHREADS;
+  quit = 0;
+  for (workerCount = 0; workerCount < threads - 1; ++workerCount)
+    if (pthread_create(&workers[workerCount], NULL, workerMain, NULL))
+      break;
+  return 0;
+}
+
+int jobsFree()
+{
+  pthread_mutex_lock(&lock);
+  quit = 1;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+  for (int i = 0; i < workerCount; ++i)
+    pthread_join(workers[i], NULL);
+  workerCount = 0;
+  return 0;
+}
+
+int jobsThreads()
+{
+  return workerCount + 1;
+}
+
+int jobsRun(int count, int batch, jobFunc fn, void *user)
+{
+  if (count <= 0) return 0;
+  int batches = (count + batch - 1) / batch;
+  // Not worth waking anyone for
+  if (!workerCount || batches == 1)
+    return fn(0, count, user);
+
+  pthread_mutex_lock(&owner);
+  pthread_mutex_lock(&lock);
+  // A worker that slept through the last job may still be looking at it
+  while (busy)
+    pthread_cond_wait(&done, &lock);
+  jobFn = fn;
+  jobUser = user;
+  jobCount = count;
+  jobBatch = batch;
+  jobBatches = batches;
+  nextBatch = 0;
+  generation++;
+  pthread_cond_broadcast(&wake);
+  pthread_mutex_unlock(&lock);
+
+  runBatches();
+
+  // Every batch has been handed out, wait for the workers still on theirs
+  pthread_mutex_lock(&lock);
+  while (busy)
+    pthread_cond_wait(&done, &lock);
+  pthread_mutex_unlock(&lock);
+  pthread_mutex_unlock(&owner);
+  return 0;
+}
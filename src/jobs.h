@@ -0,0 +1,20 @@
+#ifndef JOBS_H
+#define JOBS_H
+
+// Most threads the pool will start, counting the calling thread
+#define MAXTHREADS 16
+
+// Work on the items from begin up to (not including) end
+typedef int (*jobFunc)(int begin, int end, void *user);
+
+// Start threads - 1 workers, 0 uses one thread per core
+int jobsInit(int threads);
+int jobsFree();
+// Threads doing jobs, counting the calling thread
+int jobsThreads();
+// Split count items into batches of batch and run fn on all of them across
+// the pool, the calling thread works too. Returns once every batch is done.
+// Jobs from different threads take turns.
+int jobsRun(int count, int batch, jobFunc fn, void *user);
+
+#endif /* JOBS_H */
@@ -0,0 +1,87 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include "log.h"
+
+// Room for a few hundred lines between flushes
+#define LOGBUFFER 16384
+// Longest message, longer ones are cut off
+#define LOGLINE 512
+
+static const char *levelNames[] = { "debug", "info", "warn", "error", "none" };
+static int minLevel = LOGLEVEL_INFO;
+static FILE *output;
+static char buffer[LOGBUFFER];
+static size_t used;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+int logSetLevel(int level)
+{
+  minLevel = level;
+  return 0;
+}
+
+int logLevelFromName(const char *name)
+{
+  for (int level = 0; level <= LOGLEVEL_NONE; ++level)
+    if (!strcmp(name, levelNames[level]))
+      return level;
+  return -1;
+}
+
+int logSetOutput(FILE *out)
+{
+  logFlush();
+  output = out;
+  return 0;
+}
+
+// Write out the buffer, the lock has to be held
+static int flushLocked()
+{
+  if (used)
+  {
+    FILE *out = output ? output : stderr;
+    fwrite(buffer, 1, used, out);
+    fflush(out);
+  }
+  used = 0;
+  return 0;
+}
+
+int logMessage(int level, const char *format, ...)
+{
+  if (level < minLevel)
+    return 0;
+  char line[LOGLINE];
+  int n = snprintf(line, sizeof(line), "%s: ", levelNames[level]);
+  va_list args;
+  va_start(args, format);
+  int m = vsnprintf(line + n, sizeof(line) - n - 1, format, args);
+  va_end(args);
+  if (m > 0)
+    n += m;
+  if (n > LOGLINE - 2)
+    n = LOGLINE - 2;
+  line[n++] = '\n';
+
+  pthread_mutex_lock(&lock);
+  if (used + n > LOGBUFFER)
+    flushLocked();
+  memcpy(buffer + used, line, n);
+  used += n;
+  // Errors shouldn't wait, they may be the last thing printed
+  if (level >= LOGLEVEL_ERROR)
+    flushLocked();
+  pthread_mutex_unlock(&lock);
+  return 0;
+}
+
+int logFlush()
+{
+  pthread_mutex_lock(&lock);
+  flushLocked();
+  pthread_mutex_unlock(&lock);
+  return 0;
+}
@@ -0,0 +1,21 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdio.h>
+
+enum {LOGLEVEL_DEBUG, LOGLEVEL_INFO, LOGLEVEL_WARN, LOGLEVEL_ERROR, LOGLEVEL_NONE}; // Log levels, least important first
+
+// Messages are formatted into a buffer and only written out by logFlush (or
+// when the buffer fills), so logging from a tick never waits on the
+// terminal. Messages below the level are dropped before being formatted.
+
+int logSetLevel(int level);
+// Level from its name (debug, info, warn, error, none), -1 if unknown
+int logLevelFromName(const char *name);
+// Write messages to out instead of stderr
+int logSetOutput(FILE *out);
+int logMessage(int level, const char *format, ...);
+// Write out every buffered message
+int logFlush();
+
+#endif /* LOG_H */
@@ -1,29 +1,85 @@
 #include <raylib.h>
+#ifdef HEADLESS
+// raylib isn't linked into headless builds so raymath has to be inlined
+#define RAYMATH_STATIC_INLINE
+#endif /* ifdef HEADLESS */
 #include <raymath.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "assets.h"
+#include "atlas.h"
+#include "bake.h"
+#include "bundle.h"
+#include "flow.h"
+#include "gen.h"
+#include "grid.h"
+#include "headless.h"
+#include "horde.h"
+#include "jobs.h"
+#include "log.h"
+#include "profile.h"
+#include "region.h"
+#include "replay.h"
+#include "rng.h"
+#include "snapshot.h"
+#include "spectate.h"
+#include "stream.h"
+#include "world.h"
 
 // TODO: Airdrops
 // TODO: Sprint meter (regenerates slowly, allows for short sprints)
 
-#define CHUNKSIZE 128
 #define cameraZoom 1.0f
+// Default memory for inactive chunks, as many bytes as 25 unpacked ones
 #define MAXCHUNKS 25
 #define TILESONSCREEN 20
-#define WIDECHUNKS 50 
+// Default for how many chunks the active window reaches out from the
+// player's chunk, --view-radius changes it
+#define VIEWRADIUS 1
+// Tiles the player goes into the next chunk before the window follows, so
+// walking along a chunk border doesn't swap chunks back and forth
+#define RECENTRESLACK 16
+// Seconds ahead of the player that chunks start loading
+#define STREAMLOOKAHEAD 1.0f
+// Default frame rate cap, the simulation runs at its own tick rate
 #define FPS 120
+#define TICKRATE 120
 #define SPEED 9
-#define MAXZOMBIES 1000
 // This does nothing rn
 #define NUMSPAWNLOCATIONS 4
 #define ZOMBIESPEED 7
+// Zombies closer than this push each other apart
+#define ZOMBIERADIUS 0.3f
+// Default for how many zombies can be around at once
+#define MAXZOMBIES 1000
+// Zombies per job when the horde is updated across threads
+#define HORDEBATCH 256
+// Distance bands the horde is updated in, band b every 1 << b ticks. Off
+// screen zombies don't need every step, they take bigger ones less often.
+#define LODBANDS 4
+// Ticks between the horde being sorted into bands, every band gets a turn
+#define LODCYCLE (1 << (LODBANDS - 1))
+// Tiles of baked ground redrawn per frame at most, about 2 ms. A chunk that
+// just came into view is drawn a few blocks a frame.
+#define BAKEBUDGET 2048
 // Shotgun Cooldown 0.5s
 #define SGCD 0.5
+// Save-states start with this, spectators' first records with the other
+#define STATEMAGIC "HSAV"
+#define SPECTATEMAGIC "HSPC"
+#define STATEVERSION 2
+// F5 saves the game here and F9 loads it back
+#define QUICKSAVE "quicksave.hoard"
 // #define debug true
 
 enum {UP, DOWN, LEFT, RIGHT}; // Directions
 enum {PLAYING, GAMEOVER, START, PAUSED}; // Game screens
+enum {SCENARIO_IDLE, SCENARIO_CHASE, SCENARIO_WALK, SCENARIO_RANDOM, SCENARIO_BOUNDARY, SCENARIO_WALLS, SCENARIO_SCRIPT, SCENARIO_REPLAY}; // Headless scenarios
+// Names of the scenarios, the ones up to SCENARIO_SCRIPT can be picked with --scenario
+static const char *scenarioNames[] = { "idle", "chase", "walk", "random", "boundary", "walls", "script", "replay" };
 
 struct player
 {
@@ -34,23 +90,40 @@ struct player
   int health;
 };
 
-struct mapChunk
-{
-  char tiles[CHUNKSIZE][CHUNKSIZE];
-  Vector2 pos;
-};
-
-static int randoms[CHUNKSIZE][CHUNKSIZE];
-
-static struct mapChunk activeChunks[4];
-// 2 Variables to store what side of the current chunk has active loaded chunks
-static char activeChunkExistsX; // -1->Left; 1->Right
-static char activeChunkExistsY; // -1->Top; 1->Below
-static struct mapChunk chunks[MAXCHUNKS] = { 0 };
-static unsigned int openSlots[MAXCHUNKS] = { -1 };
+// The active chunks, a square window activeSide chunks wide around the
+// player's chunk. It's a ring buffer: chunk (x, y) always sits in slot
+// activeSlot(x, y), so moving the window only swaps the row or column it
+// left for the one it moved onto.
+static struct mapChunk **activeChunks;
+static int activeRadius = VIEWRADIUS;
+static int activeSide, activeCount;
+static int activeOriginX, activeOriginY; // Chunk in the top left corner
+// By slot, the bake each chunk on screen is drawn from
+static struct chunkBake **chunkBakes;
+// Chunks that have been visited but aren't active
+static struct chunkCache chunkCache;
+// Chunks that fell out of the cache, on disk
+static struct regionStore regionStore;
+// Loads and stores chunks for the two above on its own thread
+static struct chunkStream chunkStream;
+// Settings for the two above, from the command line
+static const char *worldDir = NULL;
+static int flushPolicy = REGIONFLUSH_NEVER;
+static size_t chunkMemory = MAXCHUNKS * sizeof(struct mapChunk);
+// The tiles of every edited chunk, wherever it is kept, hashed together
+// for stateChecksum. setTile keeps it up to date, readState works it out
+// again from what was loaded.
+static uint32_t editedHash;
 
 int saveActiveChunk(int slot);
 int loadChunk(int slot, int xPos, int yPos);
+int recentreWindow(struct tileCoord playerTile);
+int prefetchChunks();
+int worldArg(int argc, char *argv[], int *i);
+int setupHorde(int capacity);
+int setupActiveChunks();
+int openWorld();
+int closeWorld();
 
 static int mouseMode = 2;
 static int gamePaused = 2;
@@ -58,86 +131,214 @@ static int playerDead = 0;
 static int sW = 1280;
 static int sH = 720;
 
-static unsigned int frameCount = 0;
+static unsigned int frameCount = 0; // Ticks since the game started
+static int tickRate = TICKRATE;
+#ifndef HEADLESS
+static int renderFps = FPS;
+#endif /* ifndef HEADLESS */
+// How far between the last tick and the next one this frame is, 0-1
+static float tickAlpha = 1.f;
+static Vector2 prevPlayerPos;
+// Interpolated player position that the frame is drawn around
+static Vector2 viewPos;
 static int facing = 0; // Direction the player is facing
 
-static Vector2 zombies[MAXZOMBIES];
+static struct horde horde;
+static int zombieCapacity = MAXZOMBIES;
+static struct spatialGrid zombieGrid;
+// Where each band but the last ends, in tiles from the player. The first
+// is past the corners of the screen and where zombies spawn.
+static const float lodRadius[LODBANDS - 1] = { 28, 40, 56 };
+// One past the last zombie in each band as of the last sort, zombies from
+// the last end on came after it and are updated every tick
+static int lodEnds[LODBANDS];
+// Zombies in reach of the shotgun, as big as the horde
+static int *inRange;
+// Paths to the player around solid tiles, for the horde
+static struct flowField flow;
+// Threads for the horde update, 0 for one per core
+static int threadCount = 0;
 static Vector2 spawnLocations[NUMSPAWNLOCATIONS];
 static int spawnLocationsI;
 static int spawnAt;
 static float shotgunCooldown = 0;
+// Everything random in a game comes from this, set with --seed
+static unsigned int worldSeed = 69;
+static struct rng spawnRng;
+// Every tick's input goes here when --record is given
+static const char *recordPath;
+// Where the timed sections go when --trace is given
+static const char *tracePath;
+#ifndef HEADLESS
+static int showProfile = 0; // F3 shows how long each part of a frame takes
+#endif /* ifndef HEADLESS */
+static struct replay recorder;
+// --save-state writes the game out when it closes, --load-state starts from one
+static const char *saveStatePath;
+static const char *loadStatePath;
+// Spectators watch a game through --broadcast, from another one's --spectate
+static const char *broadcastTarget;
+static const char *spectateSource;
+static struct spectateBroadcast broadcast;
+
+// Start of a save-state or a spectator's keyframe
+struct stateHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t tickRate;
+  uint32_t seed;
+  uint32_t viewRadius;
+  uint32_t zombieCapacity;
+};
 
 static Vector2 normalisedMouse;
 static Vector2 scheduledMovement;
 static struct player player = { 0 };
 static Camera2D mainCam = { 0 };
+// Tiles drawn and skipped last frame
+static int tilesVisible;
+static int tilesCulled;
+// Zombies drawn and skipped last frame
+static int zombiesVisible;
+static int zombiesCulled;
+// What the next frame draws, from prepareFrame: the on screen tiles of each
+// active chunk (as chunkVisibleRange gives them) and the zombies on screen
+static int *chunkShown;     // By slot
+static int (*chunkRanges)[4];
+static int *zombiesShown; // Indices into the horde, as big as the horde
 
 float radianConvert(float angle);
 int fullscreenAdjust();
-int xorShift32(int state);
-int findChunk(int length, struct mapChunk chunks[length], int xPos, int yPos, int flags);
-char *getTile(Vector2 pos);
+int activeSlot(int xPos, int yPos);
+int findActiveChunk(int xPos, int yPos);
+char *activeTile(struct tileCoord tile, int *slot);
+int anySolid(const Vector2 points[], int count);
+int setTile(Vector2 pos, char value);
+Vector2 nearestSpawnPoint(Vector2 pos);
+int chunkVisibleRange(const struct mapChunk *chunk, Vector2 centre, float tileSize, int range[4]);
 // int spiralFindTile(Vector2 pos, int *x, int *y, int *activeChunk, char match);  // Not implemented
 int toggleState(int *var);
+int setTickRate(int rate);
+Vector2 zombiePos(int i);
 
 int startScreen();
 int setupGame();
-int handleControls();
+int handleControls(struct tickInput *in);
+int pollInput(struct tickInput *in);
+int applyInput(const struct tickInput *in);
+int stepGame(const struct tickInput *in);
+uint32_t stateChecksum();
+uint32_t chunkTilesHash(const struct mapChunk *chunk);
+uint32_t worldTilesHash();
+int startRecording(int zombies);
+int writeState(struct snapWriter *w);
+int readState(struct snapReader *r);
+int stateSettings(const struct stateHeader *header);
+int saveState(const char *path);
+int loadState(const char *path);
+int peekState(const char *path);
+int broadcastView();
+int startBroadcast();
+int openSpectate(struct spectateClient *client);
+int watchNext(struct spectateClient *client);
+int runSpectator();
+int runHeadlessSpectator();
+int finishTrace();
+int runHeadless(int argc, char *argv[]);
+int runBench(int argc, char *argv[]);
+int fillWalls(int oneIn);
 int tick();
+int prepareFrame();
 int drawGame();
 int drawUI();
 int drawScreen(int screen);
 
-Texture2D grassTex;
-Texture2D manLeft;
-Texture2D manLeftWalk[2];
-Texture2D manRight;
-Texture2D manRightWalk[2];
-
-Texture2D zombieLeftWalk[2];
-Texture2D zombieRightWalk[2];
+#ifndef HEADLESS
+static struct spriteAtlas sprites;
+#endif /* ifndef HEADLESS */
 
 int main(int argc, char *argv[])
 {
+  #ifdef HEADLESS
+  return runHeadless(argc, argv);
+  #else
+  for (int i = 1; i < argc; ++i)
+    if (!strcmp(argv[i], "--headless"))
+      return runHeadless(argc, argv);
+    else if (!strcmp(argv[i], "--tickrate") && i + 1 < argc)
+      setTickRate(atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--fps") && i + 1 < argc)
+      renderFps = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+      threadCount = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--zombie-capacity") && i + 1 < argc)
+      zombieCapacity = atoi(argv[++i]);
+    else if (worldArg(argc, argv, &i) == -1)
+      return 1;
+
   SetConfigFlags(FLAG_WINDOW_RESIZABLE);    // Window configuration flags
   InitWindow(1280, 720, "Hoard avoidance");
-  SetTargetFPS(FPS);
+  // 0 leaves the frame rate uncapped
+  SetTargetFPS(renderFps);
   #ifndef debug
   fullscreenAdjust();
   #endif /* ifndef debug */
 
-  // Load textures
-  grassTex = LoadTexture("grass.png");
-  manLeft = LoadTexture("ManLeft.png");
-  manLeftWalk[0] = LoadTexture("ManLeftWalk1.png");
-  manLeftWalk[1] = LoadTexture("ManLeftWalk2.png");
-  manRight = LoadTexture("ManRight.png");
-  manRightWalk[0] = LoadTexture("ManRightWalk1.png");
-  manRightWalk[1] = LoadTexture("ManRightWalk2.png");
-
-  zombieLeftWalk[0] = LoadTexture("Zombie2LeftWalk1.png");
-  zombieLeftWalk[1] = LoadTexture("Zombie2LeftWalk2.png");
-  zombieRightWalk[0] = LoadTexture("Zombie2RightWalk1.png");
-  zombieRightWalk[1] = LoadTexture("Zombie2RightWalk2.png");
-
-  // Pregenerate the random textures so that rendering is faster
-  for (int x = 0; x < CHUNKSIZE; ++x)
-    for (int y = 0; y < CHUNKSIZE; ++y)
-      randoms[x][y] = xorShift32(xorShift32((int)(x) ^ 1455093647) ^ xorShift32((int)(y) ^ 1455093647));
+  // Load textures, from the bundle next to the executable if there is one
+  // so it runs from any directory without decoding a PNG
+  double loadStart = GetTime();
+  int bundled = assetsOpen(GetApplicationDirectory());
+  // The grass only gets drawn into the baked chunks
+  Image grass = assetImage("grass.png");
+  bakeSetGrass(grass);
+  assetRelease(grass);
+  // Every sprite goes in one texture so they can all be drawn in one batch
+  atlasLoad(&sprites);
+  assetsClose();
+  double loadTime = GetTime() - loadStart;
+  if (spectateSource)
+    return runSpectator();
 
   // Set up game variables
+  if (loadStatePath && peekState(loadStatePath))
+    return 1;
+  if (setupHorde(zombieCapacity))
+    return 1;
+  jobsInit(threadCount);
+  if (openWorld())
+    return 1;
   setupGame();
+  if (startRecording(0) || startBroadcast() || (loadStatePath && loadState(loadStatePath)))
+    return 1;
   BeginDrawing();
   drawScreen(START);
   EndDrawing();
+  // Time since the window opened, to keep an eye on cold starts
+  TraceLog(LOG_INFO, "STARTUP: First frame after %.1f ms, assets took %.1f ms from %s", GetTime() * 1000, loadTime * 1000, bundled ? BUNDLEFILE : "loose files");
 
-  // Main loop
+  // Main loop, the simulation steps at a fixed rate however fast frames are drawn
+  struct tickInput in;
+  double accumulator = 0;
+  int framesSinceFlush = 0;
   while (!WindowShouldClose())
   {
     // Take keyboard inputs
-    handleControls();
-    // Update game variables
-    if (!gamePaused) tick();
+    profileBegin(PROFILE_INPUT);
+    handleControls(&in);
+    profileEnd(PROFILE_INPUT);
+    // Update game variables, catching up on every tick that is due
+    accumulator += GetFrameTime();
+    // Give up on catching up after a long stall (e.g. dragging the window)
+    if (accumulator > 0.25) accumulator = 0.25;
+    while (accumulator >= 1.0 / tickRate)
+    {
+      if (!gamePaused)
+        stepGame(&in);
+      accumulator -= 1.0 / tickRate;
+    }
+    tickAlpha = gamePaused ? 1.f : accumulator * tickRate;
+    viewPos = Vector2Lerp(prevPlayerPos, player.pos, tickAlpha);
 
     if (gamePaused == 2)
     {
@@ -152,10 +353,494 @@ int main(int argc, char *argv[])
         drawGame();
       EndMode2D();
       // Draw UI stuff
+      profileBegin(PROFILE_UI);
       drawUI();
+      profileEnd(PROFILE_UI);
+      if (showProfile)
+        profileDraw(10, 190);
     EndDrawing();
+    profileFrame();
+    // Logging only ever fills a buffer, write it out once a second
+    if (++framesSinceFlush >= (renderFps ? renderFps : 60))
+    {
+      logFlush();
+      framesSinceFlush = 0;
+    }
   }
 
+  if (saveStatePath)
+    saveState(saveStatePath);
+  replayClose(&recorder);
+  spectateBroadcastClose(&broadcast);
+  closeWorld();
+  jobsFree();
+  finishTrace();
+  logFlush();
+  return 0;
+  #endif /* ifdef HEADLESS */
+}
+
+
+// Run the simulation without a window as fast as possible and report how
+// long the ticks took
+int runHeadless(int argc, char *argv[])
+{
+  int ticks = 10000, ticksGiven = 0;
+  int zombieCount = 0;
+  int scenario = SCENARIO_CHASE;
+  const char *scriptPath = NULL;
+  const char *replayPath = NULL;
+  const char *jsonPath = NULL;
+  const char *runName = NULL;
+  for (int i = 1; i < argc; ++i)
+  {
+    if (!strcmp(argv[i], "--headless"))
+      continue;
+    else if (!strcmp(argv[i], "--bench"))
+      return runBench(argc, argv);
+    else if (!strcmp(argv[i], "--json") && i + 1 < argc)
+      jsonPath = argv[++i];
+    else if (!strcmp(argv[i], "--name") && i + 1 < argc)
+      runName = argv[++i];
+    else if (!strcmp(argv[i], "--ticks") && i + 1 < argc)
+    {
+      ticks = atoi(argv[++i]);
+      ticksGiven = 1;
+    }
+    else if (!strcmp(argv[i], "--zombies") && i + 1 < argc)
+      zombieCount = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--tickrate") && i + 1 < argc)
+      setTickRate(atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--threads") && i + 1 < argc)
+      threadCount = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--zombie-capacity") && i + 1 < argc)
+      zombieCapacity = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--script") && i + 1 < argc)
+    {
+      scriptPath = argv[++i];
+      scenario = SCENARIO_SCRIPT;
+    }
+    else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+    {
+      replayPath = argv[++i];
+      scenario = SCENARIO_REPLAY;
+    }
+    else if (worldArg(argc, argv, &i) > 0)
+      continue;
+    else if (!strcmp(argv[i], "--scenario") && i + 1 < argc)
+    {
+      scenario = -1;
+      ++i;
+      for (int n = 0; n < SCENARIO_SCRIPT; ++n)
+        if (!strcmp(argv[i], scenarioNames[n])) scenario = n;
+      if (scenario == -1)
+      {
+        fprintf(stderr, "Unknown scenario: %s (idle, chase, walk, random, boundary, walls)\n", argv[i]);
+        return 1;
+      }
+    }
+    else
+    {
+      printf("Usage: %s --headless [--ticks N] [--zombies N] [--tickrate N] [--scenario name] [--script file]\n", argv[0]);
+      printf("        [--threads N] [--zombie-capacity N] [--world dir] [--chunk-memory MB] [--flush never|async|sync]\n");
+      printf("        [--view-radius N] [--save-state file] [--load-state file]\n");
+      printf("        [--broadcast file|unix:path] [--spectate file|unix:path]\n");
+      printf("        [--seed N] [--record file] [--replay file] [--json file] [--name name]\n");
+      printf("        [--trace file] [--log-level debug|info|warn|error|none]\n");
+      printf("       %s --headless --bench [--json file] [options for every run]\n", argv[0]);
+      printf(" idle     The player stands still and never fires\n");
+      printf(" chase    The player stands still and fires while the horde closes in\n");
+      printf(" walk     The player walks right forever, crossing chunk borders\n");
+      printf(" random   The player changes direction, aim and firing every quarter second\n");
+      printf(" boundary The player walks diagonally back and forth, swapping chunks both ways\n");
+      printf(" walls    The player spins on the spot firing, in a field of solid tiles\n");
+      printf(" A script has one step per line: <ticks> <keys from WASDF or -> [aimx aimy]\n");
+      printf(" A replay plays back a --record file with the settings it was made with,\n");
+      printf(" checking every tick ends the way it did when recorded\n");
+      printf(" --json appends a line of results to file, --bench runs a set of scenarios\n");
+      printf(" each in its own process and writes their results to file (bench.jsonl)\n");
+      printf(" --save-state writes the game out at the end, --load-state starts from one\n");
+      printf(" --broadcast sends the game to spectators, --spectate watches one and checks\n");
+      printf(" every record\n");
+      return 1;
+    }
+  }
+  // A replay is played with the settings it was recorded with, to its end
+  struct replay playback = { 0 };
+  if (scenario == SCENARIO_REPLAY)
+  {
+    struct replayHeader header;
+    if (replayOpen(&playback, replayPath, &header))
+    {
+      fprintf(stderr, "Not a replay: %s\n", replayPath);
+      return 1;
+    }
+    setTickRate(header.tickRate);
+    worldSeed = header.seed;
+    activeRadius = header.viewRadius;
+    zombieCapacity = header.zombieCapacity;
+    zombieCount = header.zombies;
+    // Count the ticks first so the stats can hold them all
+    struct tickInput in;
+    uint32_t checksum;
+    int record, length = 0;
+    while ((record = replayRead(&playback, &in, &checksum)) != REPLAY_END)
+      length += record == REPLAY_TICK;
+    replayClose(&playback);
+    replayOpen(&playback, replayPath, &header);
+    if (length < ticks || !ticksGiven)
+      ticks = length;
+  }
+  if (spectateSource)
+    return runHeadlessSpectator();
+  // A save-state comes with its own settings and zombies
+  if (loadStatePath)
+  {
+    if (peekState(loadStatePath))
+      return 1;
+    zombieCount = 0;
+  }
+  // Make room for every zombie asked for
+  if (zombieCount > zombieCapacity)
+    zombieCapacity = zombieCount;
+
+  // Load the script, each step holds an input for some number of ticks
+  int steps = 0, stepsCap = 0;
+  int *stepTicks = NULL;
+  struct tickInput *stepInputs = NULL;
+  if (scenario == SCENARIO_SCRIPT)
+  {
+    FILE *f = fopen(scriptPath, "r");
+    if (!f)
+    {
+      fprintf(stderr, "Could not open script: %s\n", scriptPath);
+      return 1;
+    }
+    char line[256], keys[32];
+    while (fgets(line, sizeof(line), f))
+    {
+      struct tickInput in = { 0, 0, { 0, 0 } };
+      int n, count = sscanf(line, "%d %31s %f %f", &n, keys, &in.aim.x, &in.aim.y);
+      if (count < 2 || n <= 0) continue;
+      in.mouseMode = count == 4 ? 2 : 0;
+      for (char *k = keys; *k; ++k)
+        switch (*k) {
+        case 'W': case 'w': in.keys |= INPUT_UP; break;
+        case 'S': case 's': in.keys |= INPUT_DOWN; break;
+        case 'A': case 'a': in.keys |= INPUT_LEFT; break;
+        case 'D': case 'd': in.keys |= INPUT_RIGHT; break;
+        case 'F': case 'f': in.keys |= INPUT_FIRE; break;
+        }
+      if (steps == stepsCap)
+      {
+        stepsCap = stepsCap ? stepsCap * 2 : 16;
+        stepTicks = realloc(stepTicks, sizeof(int) * stepsCap);
+        stepInputs = realloc(stepInputs, sizeof(struct tickInput) * stepsCap);
+      }
+      stepTicks[steps] = n;
+      stepInputs[steps++] = in;
+    }
+    fclose(f);
+    if (!steps)
+    {
+      fprintf(stderr, "Script has no steps: %s\n", scriptPath);
+      return 1;
+    }
+  }
+
+  if (setupHorde(zombieCapacity))
+    return 1;
+  jobsInit(threadCount);
+  if (openWorld())
+    return 1;
+  setupGame();
+  gamePaused = 0;
+  if (scenario == SCENARIO_WALLS)
+    fillWalls(4);
+  // A few walls so the chunks it starts in are edited, and have to be
+  // stored and loaded back instead of generated again
+  if (scenario == SCENARIO_BOUNDARY)
+    fillWalls(64);
+  // Before the save-state is loaded, so the recording starts with it
+  if (startRecording(zombieCount))
+    return 1;
+  if (loadStatePath)
+  {
+    double start = clockSeconds();
+    if (loadState(loadStatePath))
+    {
+      fprintf(stderr, "Could not load state: %s\n", loadStatePath);
+      return 1;
+    }
+    printf("save-state: restored in %.2f ms\n", (clockSeconds() - start) * 1000);
+  }
+
+  // Scenario input uses its own stream so it doesn't disturb the game's
+  struct rng inputRng;
+  rngSeed(&inputRng, worldSeed, RNGSTREAM_SCENARIO);
+  for (int i = 0; i < zombieCount; ++i)
+  {
+    float angle = rngFloat(&inputRng) * 6.2831853f;
+    float distance = 5 + rngFloat(&inputRng) * 20.f;
+    hordeSpawn(&horde, Vector2Add(player.pos, Vector2Rotate((Vector2){ distance, 0 }, angle)));
+  }
+  // Those walls aren't input, so the recording starts from a save-state
+  // that has them
+  if (recorder.file && (scenario == SCENARIO_WALLS || scenario == SCENARIO_BOUNDARY))
+  {
+    struct snapWriter w = { 0 };
+    if (!writeState(&w))
+      replayWriteState(&recorder, &w);
+    snapFree(&w);
+  }
+  if (startBroadcast())
+    return 1;
+
+  // Frames are worked out (not drawn) after every tick and timed apart
+  struct tickStats stats, prepareStats;
+  if (statsInit(&stats, ticks) || statsInit(&prepareStats, ticks))
+    return 1;
+  double tilesShown = 0, zombiesOnScreen = 0;
+  struct tickInput in = { 0, 0, { 0, 0 } };
+  int step = 0, stepLeft = steps ? stepTicks[0] : 0;
+  int deaths = 0;
+  uint32_t expected = 0;
+  int diverged = -1;
+  int record;
+  struct snapWriter loaded = { 0 };
+  for (int t = 0; t < ticks; ++t)
+  {
+    switch (scenario) {
+    case SCENARIO_CHASE:
+      in.keys = INPUT_FIRE;
+      in.mouseMode = 2;
+      in.aim = (Vector2){ 1, 0 };
+      break;
+    case SCENARIO_WALK:
+      in.keys = INPUT_RIGHT;
+      break;
+    case SCENARIO_BOUNDARY:
+      // Far enough each way to go past the edge where chunks are swapped
+      in.keys = t / 1300 % 2 ? INPUT_LEFT | INPUT_UP : INPUT_RIGHT | INPUT_DOWN;
+      break;
+    case SCENARIO_WALLS:
+      in.keys = INPUT_FIRE;
+      in.mouseMode = 2;
+      in.aim = Vector2Rotate((Vector2){ 100, 0 }, t * 0.05f);
+      break;
+    case SCENARIO_RANDOM:
+      if (t % (tickRate / 4) == 0)
+      {
+        in.keys = rngNext(&inputRng) & 31;
+        in.mouseMode = 2;
+        in.aim = Vector2Rotate((Vector2){ 100, 0 }, rngFloat(&inputRng) * 6.2831853f);
+      }
+      break;
+    case SCENARIO_SCRIPT:
+      // Scripts loop once they run out
+      if (!stepLeft--)
+      {
+        step = (step + 1) % steps;
+        stepLeft = stepTicks[step] - 1;
+      }
+      in = stepInputs[step];
+      break;
+    case SCENARIO_REPLAY:
+      // Games started over or loaded in the recording are here too
+      while ((record = replayRead(&playback, &in, &expected)) == REPLAY_RESET || record == REPLAY_STATE)
+      {
+        if (record == REPLAY_RESET)
+        {
+          setupGame();
+          continue;
+        }
+        int cut = replayReadState(&playback, &loaded);
+        struct snapReader r = { loaded.data, loaded.length, 0, 0 };
+        if ((cut || readState(&r)) && diverged == -1)
+          diverged = t;
+      }
+      break;
+    }
+
+    double start = clockSeconds();
+    stepGame(&in);
+    statsAdd(&stats, clockSeconds() - start);
+    if (scenario == SCENARIO_REPLAY && diverged == -1 && stateChecksum() != expected)
+      diverged = t;
+    viewPos = player.pos;
+    start = clockSeconds();
+    prepareFrame();
+    statsAdd(&prepareStats, clockSeconds() - start);
+    profileFrame();
+    tilesShown += tilesVisible;
+    zombiesOnScreen += zombiesVisible;
+
+    // Keep going after the player dies so the load stays the same
+    if (playerDead)
+    {
+      deaths++;
+      playerDead = 0;
+      gamePaused = 0;
+    }
+  }
+
+  snapFree(&loaded);
+  int alive = horde.count;
+  // The cache and the store can only be looked at once streaming is done
+  streamWait(&chunkStream);
+  printf("scenario: %s, ticks: %d, kernels: %s, threads: %d\n", scenarioNames[scenario], ticks, hordeKernelName(), jobsThreads());
+  printf("zombies: %d at start, %d at end, kills: %d, deaths: %d\n", zombieCount, alive, player.kills, deaths);
+  printf("chunks: %d cached in %zu bytes, %d saved to disk, %d loaded from disk\n", chunkCache.count, chunkCache.used, regionStore.saved, regionStore.loaded);
+  printf("streaming: %d chunks prefetched, %d were ready in time, %d waited for\n", chunkStream.prefetched, chunkStream.hits, chunkStream.stalls);
+  printf("state checksum: %08x\n", stateChecksum());
+  if (broadcastTarget)
+    printf("broadcast: %zu bytes, %.2f KB a second of game\n", broadcast.out.sent, broadcast.out.sent / 1024.0 / ((double) ticks / tickRate));
+  if (scenario == SCENARIO_REPLAY)
+  {
+    if (diverged == -1)
+      printf("replay: all %d ticks matched the recording\n", ticks);
+    else
+      printf("replay: diverged from the recording at tick %d\n", diverged);
+  }
+  statsReport(&stats, stdout);
+  printf("frame prep: p50 %.4f ms, p99 %.4f ms, max %.4f ms, %.0f tiles and %.0f zombies on screen on average\n",
+    statsPercentile(&prepareStats, 0.5) * 1000, statsPercentile(&prepareStats, 0.99) * 1000, statsPercentile(&prepareStats, 1) * 1000,
+    tilesShown / ticks, zombiesOnScreen / ticks);
+  printf("sections (ms per tick):");
+  for (int i = 0; i < PROFILESECTIONS; ++i)
+    printf(" %s %.4f", profileNames[i], profileTotal(i) * 1000 / ticks);
+  printf("\n");
+  if (jsonPath)
+  {
+    FILE *f = fopen(jsonPath, "a");
+    if (!f)
+    {
+      fprintf(stderr, "Could not write results to: %s\n", jsonPath);
+      return 1;
+    }
+    fprintf(f, "{ \"name\": \"%s\", \"scenario\": \"%s\", \"ticks\": %d, \"threads\": %d, \"kernels\": \"%s\", ",
+      runName ? runName : scenarioNames[scenario], scenarioNames[scenario], ticks, jobsThreads(), hordeKernelName());
+    fprintf(f, "\"zombies_start\": %d, \"zombies_end\": %d, \"kills\": %d, \"deaths\": %d, \"chunks_saved\": %d, \"chunks_loaded\": %d, ",
+      zombieCount, alive, player.kills, deaths, regionStore.saved, regionStore.loaded);
+    fprintf(f, "\"chunks_prefetched\": %d, \"chunk_stalls\": %d, ", chunkStream.prefetched, chunkStream.stalls);
+    fprintf(f, "\"tiles_on_screen\": %.1f, \"zombies_on_screen\": %.1f, \"peak_rss_kb\": %ld, \"tick\": ",
+      tilesShown / ticks, zombiesOnScreen / ticks, peakRssKb());
+    statsJson(&stats, f);
+    fprintf(f, ", \"prepare\": ");
+    statsJson(&prepareStats, f);
+    fprintf(f, " }\n");
+    fclose(f);
+  }
+  statsFree(&stats);
+  statsFree(&prepareStats);
+  if (saveStatePath)
+  {
+    double start = clockSeconds();
+    if (saveState(saveStatePath))
+    {
+      fprintf(stderr, "Could not save state: %s\n", saveStatePath);
+      return 1;
+    }
+    printf("save-state: written in %.2f ms\n", (clockSeconds() - start) * 1000);
+  }
+  replayClose(&playback);
+  replayClose(&recorder);
+  spectateBroadcastClose(&broadcast);
+  free(stepTicks);
+  free(stepInputs);
+  closeWorld();
+  jobsFree();
+  finishTrace();
+  logFlush();
+  return diverged == -1 ? 0 : 2;
+}
+
+// The benchmark suite, each run is a set of headless options
+static const struct { const char *name; const char *args; } benchRuns[] = {
+  { "idle", "--scenario idle --ticks 20000" },
+  { "chase-1k", "--scenario chase --zombies 1000 --ticks 5000" },
+  { "chase-10k", "--scenario chase --zombies 10000 --ticks 1000" },
+  { "chase-100k", "--scenario chase --zombies 100000 --ticks 100" },
+  // The chunks it starts in have walls, so they go to disk when swapped
+  // out and come back from it on the way back
+  { "boundary", "--scenario boundary --ticks 10400 --chunk-memory 0" },
+  { "walls", "--scenario walls --zombies 1000 --ticks 5000" },
+  // The horde trails behind the player, a lot of it off screen
+  { "render", "--scenario walk --zombies 10000 --ticks 2000" },
+};
+
+// Run every benchmark in its own process, so each one's peak memory is its
+// own and nothing one leaves behind slows the next. Options given with
+// --bench are passed on to every run, after the run's own.
+int runBench(int argc, char *argv[])
+{
+  const char *jsonPath = "bench.jsonl";
+  for (int i = 1; i + 1 < argc; ++i)
+    if (!strcmp(argv[i], "--json"))
+      jsonPath = argv[i + 1];
+  FILE *f = fopen(jsonPath, "w");
+  if (!f)
+  {
+    fprintf(stderr, "Could not write results to: %s\n", jsonPath);
+    return 1;
+  }
+  fclose(f);
+
+  int failed = 0;
+  for (size_t r = 0; r < sizeof(benchRuns) / sizeof(benchRuns[0]); ++r)
+  {
+    printf("== %s: %s\n", benchRuns[r].name, benchRuns[r].args);
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+      perror("fork");
+      return 1;
+    }
+    if (pid == 0)
+    {
+      char args[256];
+      char *runArgv[64];
+      int runArgc = 0;
+      runArgv[runArgc++] = argv[0];
+      snprintf(args, sizeof(args), "%s", benchRuns[r].args);
+      for (char *arg = strtok(args, " "); arg && runArgc < 48; arg = strtok(NULL, " "))
+        runArgv[runArgc++] = arg;
+      for (int i = 1; i < argc && runArgc < 60; ++i)
+        if (strcmp(argv[i], "--bench") && strcmp(argv[i], "--headless"))
+          runArgv[runArgc++] = argv[i];
+      runArgv[runArgc++] = "--name";
+      runArgv[runArgc++] = (char *) benchRuns[r].name;
+      runArgv[runArgc++] = "--json";
+      runArgv[runArgc++] = (char *) jsonPath;
+      runArgv[runArgc] = NULL;
+      int result = runHeadless(runArgc, runArgv);
+      fflush(stdout);
+      _exit(result);
+    }
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status))
+    {
+      fprintf(stderr, "Benchmark %s failed\n", benchRuns[r].name);
+      failed = 1;
+    }
+  }
+  printf("Results written to %s\n", jsonPath);
+  return failed;
+}
+
+// Make about one in oneIn of the active chunks' tiles solid, leaving the
+// player room to stand
+int fillWalls(int oneIn)
+{
+  for (int c = 0; c < activeCount; ++c)
+    for (int x = 0; x < CHUNKSIZE; ++x)
+      for (int y = 0; y < CHUNKSIZE; ++y)
+      {
+        Vector2 pos = { CHUNKSIZE * activeChunks[c]->pos.x + x + 0.5f, CHUNKSIZE * activeChunks[c]->pos.y + y + 0.5f };
+        if (Vector2Distance(pos, player.pos) > 3 && rngHash(worldSeed, RNGSTREAM_SCENARIO, pos.x, pos.y) % oneIn == 0)
+          setTile(pos, 1);
+      }
   return 0;
 }
 
@@ -166,6 +851,8 @@ int setupGame()
   playerDead = 0;
   player.pos.x = 10.f;
   player.pos.y = 10.f;
+  prevPlayerPos = player.pos;
+  viewPos = player.pos;
   player.weapon = 1;
   player.kills = 0;
   player.money = 50;
@@ -175,34 +862,54 @@ int setupGame()
   mainCam.offset = (Vector2){ 0.f, 0.f };
   mainCam.rotation = 0.0f;
   // Reset chunks
-  memset(chunks, 0, sizeof(chunks));
-  memset(openSlots, -1, sizeof(openSlots));
-  memset(activeChunks, 0, sizeof(activeChunks));
-  activeChunks[0].pos = (Vector2){ -1.f, -1.f };
-  activeChunks[1].pos = (Vector2){ 0.f, -1.f };
-  activeChunks[2].pos = (Vector2){ -1.f, 0.f };
-  activeChunks[3].pos = (Vector2){ 0.f, 0.f };
-  activeChunkExistsX = -1;
-  activeChunkExistsY = -1;
+  streamReset(&chunkStream, worldSeed);
+  cacheReset(&chunkCache);
+  regionReset(&regionStore);
+  // The window starts centred on the player's chunk
+  activeOriginX = activeOriginY = -activeRadius;
+  for (int y = activeOriginY; y < activeOriginY + activeSide; ++y)
+    for (int x = activeOriginX; x < activeOriginX + activeSide; ++x)
+      activeChunks[activeSlot(x, y)] = cacheNewChunk(&chunkCache, x, y);
+  genChunks(activeChunks, activeCount, worldSeed);
+  editedHash = 0;
+  bakeForgetAll();
+  flowClear(&flow);
   // Clear out the zombies
-  SetRandomSeed(69);
+  rngSeed(&spawnRng, worldSeed, RNGSTREAM_SPAWN);
   Vector2 v;
-  for (int i = 0; i < MAXZOMBIES; ++i)
-    zombies[i] = (Vector2){ 0, 0 };
+  hordeClear(&horde);
+  memset(lodEnds, 0, sizeof(lodEnds));
   for (int i = 0; i < NUMSPAWNLOCATIONS; ++i)
     spawnLocations[i] = (Vector2){ 0, 0 };
   spawnLocationsI = 0;
+  // Spectators need the new world
+  broadcast.view.resync = 1;
+  if (recorder.file)
+    replayWriteReset(&recorder);
 
   return 0;
 }
 
 
+Vector2 zombiePos(int i)
+{
+  return (Vector2){ horde.x[i], horde.y[i] };
+}
+
+int setTickRate(int rate)
+{
+  // Animations step every tickRate / 5 ticks so don't go too low
+  tickRate = rate < 10 ? 10 : rate;
+  return 0;
+}
+
 int toggleState(int *var)
 {
   *var = !*var;
   return !*var;
 }
 
+#ifndef HEADLESS
 int fullscreenAdjust()
 {
   int display = GetCurrentMonitor();
@@ -222,7 +929,7 @@ int fullscreenAdjust()
 }
 
 
-int handleControls()
+int handleControls(struct tickInput *in)
 {
   // Mouse Mode
   if (IsKeyPressed(KEY_M)) mouseMode = 2;
@@ -231,9 +938,16 @@ int handleControls()
   // Fullscreening
   if (IsKeyPressed(KEY_F11)) fullscreenAdjust();
 
+  // Profiler overlay
+  if (IsKeyPressed(KEY_F3)) showProfile = !showProfile;
+
   // Pausing
   if (IsKeyPressed(KEY_P) && !playerDead) toggleState(&gamePaused);
 
+  // Quicksave, and quickload paused so there's time to get ready
+  if (IsKeyPressed(KEY_F5)) saveState(QUICKSAVE);
+  if (IsKeyPressed(KEY_F9) && !loadState(QUICKSAVE)) gamePaused = 1;
+
   // Restarting
   if (playerDead && IsKeyPressed(KEY_ENTER))
   {
@@ -241,185 +955,301 @@ int handleControls()
     setupGame();
   }
 
+  // Read the input the ticks this frame will use
+  pollInput(in);
+
+  #ifdef debug
+  if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) || IsKeyDown(KEY_SPACE))
+    // normalisedMouse
+    setTile(Vector2Add(Vector2Scale(normalisedMouse, (float) TILESONSCREEN / sH), player.pos), 1);
+  #endif /* ifdef debug */
+  return 0;
+}
+
+// Fill in a tick of input from the keyboard and mouse
+int pollInput(struct tickInput *in)
+{
+  in->keys = 0;
+  if (IsKeyDown(KEY_W)) in->keys |= INPUT_UP;
+  if (IsKeyDown(KEY_S)) in->keys |= INPUT_DOWN;
+  if (IsKeyDown(KEY_A)) in->keys |= INPUT_LEFT;
+  if (IsKeyDown(KEY_D)) in->keys |= INPUT_RIGHT;
+  if (IsMouseButtonDown(MOUSE_BUTTON_LEFT) || IsKeyDown(KEY_SPACE)) in->keys |= INPUT_FIRE;
+  in->mouseMode = mouseMode;
+  in->aim = Vector2Add(GetMousePosition(), (Vector2){ -0.5 * sW, -0.5 * sH });
+  return 0;
+}
+#endif /* ifndef HEADLESS */
+
+
+// Move and aim the player and fire the shotgun
+int applyInput(const struct tickInput *in)
+{
   // Handle movement; peform collision check with tile
   scheduledMovement = (Vector2){ 0, 0 };
-  if (IsKeyDown(KEY_W))
-    scheduledMovement.y -= (float) SPEED / FPS;
-  if (IsKeyDown(KEY_S))
-    scheduledMovement.y += (float) SPEED / FPS;
-  if (IsKeyDown(KEY_A))
-    scheduledMovement.x -= (float) SPEED / FPS;
-  if (IsKeyDown(KEY_D))
-    scheduledMovement.x += (float) SPEED / FPS;
+  if (in->keys & INPUT_UP)
+    scheduledMovement.y -= (float) SPEED / tickRate;
+  if (in->keys & INPUT_DOWN)
+    scheduledMovement.y += (float) SPEED / tickRate;
+  if (in->keys & INPUT_LEFT)
+    scheduledMovement.x -= (float) SPEED / tickRate;
+  if (in->keys & INPUT_RIGHT)
+    scheduledMovement.x += (float) SPEED / tickRate;
 
   // Set player animation direction
   if (scheduledMovement.x > 0) facing = 1;
   if (scheduledMovement.x < 0) facing = 0;
 
   // Player direction
-  if (!mouseMode)
+  if (!in->mouseMode)
   {
     if (scheduledMovement.x != 0.f || scheduledMovement.y != 0.f)
       normalisedMouse = scheduledMovement;
   }
-  else if (mouseMode == 1)
+  else if (in->mouseMode == 1)
   {
     if (scheduledMovement.x != 0.f || scheduledMovement.y != 0.f)
     normalisedMouse = Vector2Scale(scheduledMovement, -1.f);
   }
-  else normalisedMouse = Vector2Add(GetMousePosition(), (Vector2){ -0.5 * sW, -0.5 * sH });
+  else normalisedMouse = in->aim;
 
   float angle;
   Vector2 zom;
-  int chunk, chunkx, chunky;
 
-  if ((IsMouseButtonDown(MOUSE_BUTTON_LEFT) || IsKeyDown(KEY_SPACE)) && shotgunCooldown > SGCD)
+  if ((in->keys & INPUT_FIRE) && shotgunCooldown > SGCD)
   {
     shotgunCooldown = 0.f;
     // Check for all zombie in 360 range then refine
-    for (int i = 0; i < MAXZOMBIES; ++i)
-      if (zombies[i].x != 0)
-        if (Vector2Distance(zombies[i], player.pos) <= 3)
-        {
-          // Check for all the zombies within 45 degrees of aimed direction
-          angle = Vector2Angle(normalisedMouse, Vector2Subtract(zombies[i], player.pos));
-          if (angle > -0.785398 && angle < 0.785398)
-          {
-            // Delete the zombie and set the tile at its location to solid
-            *getTile(zombies[i]) = 1;
-            spawnLocations[spawnLocationsI] = zombies[i];
-            spawnLocationsI = ++spawnLocationsI >= NUMSPAWNLOCATIONS ? 0 : spawnLocationsI;
-            zombies[i] = (Vector2){ 0, 0 };
-            // Increment player kills
-            player.kills++;
-          }
-        }
+    int hits = hordeInRange(&horde, player.pos, 3, inRange);
+    int shot = 0;
+    for (int k = 0; k < hits; ++k)
+    {
+      int i = inRange[k];
+      zom = zombiePos(i);
+      // Check for all the zombies within 45 degrees of aimed direction
+      angle = Vector2Angle(normalisedMouse, Vector2Subtract(zom, player.pos));
+      if (angle > -0.785398 && angle < 0.785398)
+        // Killing moves zombies around, so go by handle
+        inRange[shot++] = horde.handle[i];
+    }
+    for (int k = 0; k < shot; ++k)
+    {
+      int i = hordeFind(&horde, inRange[k]);
+      zom = zombiePos(i);
+      // Delete the zombie and set the tile at its location to solid
+      setTile(zom, 1);
+      spawnLocations[spawnLocationsI] = zom;
+      spawnLocationsI = ++spawnLocationsI >= NUMSPAWNLOCATIONS ? 0 : spawnLocationsI;
+      hordeKill(&horde, i);
+      // Increment player kills
+      player.kills++;
+    }
   }
-
-
-  #ifdef debug
-  if (IsMouseButtonDown(MOUSE_BUTTON_RIGHT) || IsKeyDown(KEY_SPACE))
-    // normalisedMouse
-    *getTile(Vector2Add(Vector2Scale(normalisedMouse, (float) TILESONSCREEN / sH), player.pos)) = 1;
-  #endif /* ifdef debug */
   return 0;
 }
 
 
-int tick()
+// What the threads moving the horde share
+struct chaseJob
 {
-  // Cooldown
-  shotgunCooldown += 1.f / FPS;
-  // Animate
-  frameCount++;
-  // Move zombies towards player
-  float distance;
-  int zombiesToPlace = GetRandomValue(1, FPS) / FPS;
-  // Try to spawn 4 zombies every half second
-  int tileZombies = (GetRandomValue(1, FPS) / FPS) * 4;
-  for (int i = 0; i < MAXZOMBIES; ++i)
-    if (zombies[i].x != 0)
-    {
-      distance = Vector2Distance(player.pos, zombies[i]);
-      // Check if player is dead
-      if (distance < 0.5f)
-      {
-        playerDead = 1;
-        gamePaused = 1;
-      }
-      // Vector2Add(player.pos, (Vector2){ GetRandomValue(-5, 5), GetRandomValue(-5, 5)})
-      zombies[i] = Vector2Lerp(zombies[i], player.pos, (float) ZOMBIESPEED / FPS / distance);
-      // Really inefficent but check for collisions with all other zombies
-      // int touching = 0;
-      for (int j = 0; j < MAXZOMBIES; ++j)
-      {
-        if (i == j) continue;
-        float xSep = zombies[i].x - zombies[j].x;
-        float ySep = zombies[i].y - zombies[j].y;
-        if (xSep > 0.15 || xSep < -0.15 || ySep > 0.15 || xSep < -0.15) continue;
-        float distance = Vector2Distance(zombies[i], zombies[j]);
-        if (distance > 0.3f) continue;
-        zombies[i] = Vector2Lerp(zombies[j], zombies[i], 2);
-        // if (touching++ >= 5) break;
-      }
-      // printf("%d\n", touching);
-    }
-    else if (zombiesToPlace)
-    {
-      zombies[i] = Vector2Add(player.pos, Vector2Rotate((Vector2){ TILESONSCREEN + GetRandomValue(0, 5), 0 }, 42069.f / (rand() % 3600)));
-      zombiesToPlace--;
-    }
-    else if (tileZombies)
-    {
-      if (spawnLocations[tileZombies-1].x != 0)
-        zombies[i] = spawnLocations[tileZombies-1];
-      tileZombies--;
-    }
-  
+  Vector2 target;
+  float step;
+  int caught;
+};
 
+// Zombies updated this tick, a run of indices from each band
+struct lodSlice
+{
+  int begin, end;
+  int ticks; // Ticks since this run was last updated
+};
 
-  // Get the chunk that the player is in
-  int px = player.pos.x > 0 ? (int) player.pos.x : (int) player.pos.x - 1;
-  int py = player.pos.y > 0 ? (int) player.pos.y : (int) player.pos.y - 1;
-  py++;
-  if (px < 10) px++;
-  int chunkx = px > 0 ? (int)(px-1) / 128 : (int) px / 128 - 1;
-  int chunky = py > 0 ? (int)(py-1) / 128 : (int) py-- / 128 - 1;
-  int offsetx = (unsigned int)(px - 1) %  128;
-  int offsety = (unsigned int)(py - 1) %  128;
-  offsetx = (int)(player.pos.x - CHUNKSIZE * chunkx);
-  offsety = (int)(player.pos.y - CHUNKSIZE * chunky);
+static struct lodSlice lodSlices[LODBANDS + 1];
+static int lodSliceCount;
+static int lodWork; // Zombies in all the slices
 
+// Work on the items from begin up to end that were last updated ticks ago
+typedef int (*lodFunc)(int begin, int end, int ticks, void *user);
 
-  // Make sure that we know where the active chunks around us are
-  // int x, y;
-  for (int i = 0; i < 4; ++i)
-  {
-    if ((int) activeChunks[i].pos.x != chunkx)
-      activeChunkExistsX = -1 * (chunkx - (int) activeChunks[i].pos.x);
-    if ((int) activeChunks[i].pos.y != chunky)
-      activeChunkExistsY = -1 * (chunky - (int) activeChunks[i].pos.y);
-  }
+struct lodJob
+{
+  lodFunc fn;
+  void *user;
+};
 
-  // Perform check to see if player can move to tile (Check collision)
-  player.pos = Vector2Add(player.pos, scheduledMovement);
-  int canMoveX = 1, canMoveY = 1;
-  if (*getTile(Vector2Add(player.pos, (Vector2){ 0, -0.29 })))
-    canMoveY = false;
-  else
+// Pick this tick's slices: band b is cut into 1 << b runs and one is done
+// each tick, so far bands cost a fraction of near ones
+static int lodSchedule()
+{
+  lodSliceCount = lodWork = 0;
+  int begin = 0;
+  for (int b = 0; b <= LODBANDS; ++b)
   {
-    if (*getTile(Vector2Add((Vector2){ player.pos.x - scheduledMovement.x , player.pos.y }, (Vector2){ -0.29, -0.29 })))
-      canMoveY = 0;
-    if (*getTile(Vector2Add((Vector2){ player.pos.x - scheduledMovement.x , player.pos.y }, (Vector2){ -0.29, 0.29 })))
-      canMoveY = 0;
+    // Past the bands come the zombies spawned since the sort
+    int end = b < LODBANDS ? lodEnds[b] : horde.count;
+    int period = b < LODBANDS ? 1 << b : 1;
+    int slice = frameCount % period;
+    int length = end - begin;
+    struct lodSlice s = { begin + length * slice / period, begin + length * (slice + 1) / period, period };
+    if (s.end > s.begin)
+    {
+      lodSlices[lodSliceCount++] = s;
+      lodWork += s.end - s.begin;
+    }
+    begin = end;
   }
-  if (*getTile(Vector2Add(player.pos, (Vector2){ 0, 0.29 })))
-    canMoveY = false;
-  else
+  return 0;
+}
+
+// Jobs number the zombies of the slices one after the other
+static int lodBatch(int begin, int end, void *user)
+{
+  struct lodJob *job = user;
+  int offset = 0;
+  for (int s = 0; s < lodSliceCount && offset < end; ++s)
   {
-    if (*getTile(Vector2Add((Vector2){ player.pos.x - scheduledMovement.x , player.pos.y }, (Vector2){ 0.29, -0.29 })))
-      canMoveY = 0;
-    if (*getTile(Vector2Add((Vector2){ player.pos.x - scheduledMovement.x , player.pos.y }, (Vector2){ 0.29, 0.29 })))
-      canMoveY = 0;
+    const struct lodSlice *slice = &lodSlices[s];
+    int length = slice->end - slice->begin;
+    int from = begin > offset ? begin - offset : 0;
+    int to = end - offset < length ? end - offset : length;
+    if (from < to)
+      job->fn(slice->begin + from, slice->begin + to, slice->ticks, job->user);
+    offset += length;
   }
-  if (*getTile(Vector2Add(player.pos, (Vector2){ -0.29, 0 })))
-    canMoveX = false;
-  else
+  return 0;
+}
+
+// jobsRun over this tick's slices
+static int lodRun(lodFunc fn, void *user)
+{
+  struct lodJob job = { fn, user };
+  return jobsRun(lodWork, HORDEBATCH, lodBatch, &job);
+}
+
+static int chaseBatch(int begin, int end, int ticks, void *user)
+{
+  struct chaseJob *job = user;
+  if (hordeChaseRange(&horde, begin, end, job->target, job->step * ticks, 0.5f))
+    __atomic_store_n(&job->caught, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+static int steerBatch(int begin, int end, int ticks, void *user)
+{
+  (void) ticks;
+  (void) user;
+  for (int i = begin; i < end; ++i)
+    hordeSetGoal(&horde, i, flowWaypoint(&flow, (Vector2){ horde.x[i], horde.y[i] }, player.pos));
+  return 0;
+}
+
+static int separateBatch(int begin, int end, int ticks, void *user)
+{
+  (void) ticks;
+  (void) user;
+  return hordeSeparate(&horde, &zombieGrid, ZOMBIERADIUS, begin, end);
+}
+
+int tick()
+{
+  profileBegin(PROFILE_ZOMBIES);
+  // Keep where everything was so frames can be drawn between ticks
+  prevPlayerPos = player.pos;
+  hordeSnapshot(&horde);
+  // Cooldown
+  shotgunCooldown += 1.f / tickRate;
+  // Animate
+  frameCount++;
+  // Sort the horde into bands once every band has had its turn, kills in
+  // between only ever shorten them
+  if (frameCount % LODCYCLE == 0)
+    hordeSortBands(&horde, player.pos, lodRadius, LODBANDS, lodEnds);
+  for (int b = 0; b < LODBANDS; ++b)
+    lodEnds[b] = lodEnds[b] < horde.count ? lodEnds[b] : horde.count;
+  lodSchedule();
+  // Bring the paths up to date, then point every zombie along them
+  const struct mapChunk *chunkGrid[FLOWSIDE][FLOWSIDE];
+  int flowOriginX = activeOriginX + activeRadius - FLOWSIDE / 2;
+  int flowOriginY = activeOriginY + activeRadius - FLOWSIDE / 2;
+  for (int y = 0; y < FLOWSIDE; ++y)
+    for (int x = 0; x < FLOWSIDE; ++x)
+    {
+      int slot = findActiveChunk(flowOriginX + x, flowOriginY + y);
+      chunkGrid[y][x] = slot == -1 ? NULL : activeChunks[slot];
+    }
+  // Enough of the field a tick that a search finishes in the time the
+  // player takes to walk a tile, so the field is never more than a couple
+  // of tiles behind whatever the tick rate
+  int flowBudget = FLOWSIZE * FLOWSIZE * SPEED / tickRate + 1;
+  flowUpdate(&flow, chunkGrid, flowOriginX, flowOriginY, tileFromPos(player.pos), flowBudget);
+  lodRun(steerBatch, NULL);
+  // Move zombies towards player, the player dies if one was already touching.
+  // Far zombies make up for the ticks they sat out.
+  struct chaseJob chase = { player.pos, (float) ZOMBIESPEED / tickRate, 0 };
+  lodRun(chaseBatch, &chase);
+  if (chase.caught)
   {
-    if (*getTile(Vector2Add((Vector2){ player.pos.x, player.pos.y - scheduledMovement.y }, (Vector2){ -0.29, -0.29 })))
-      canMoveX = 0;
-    if (*getTile(Vector2Add((Vector2){ player.pos.x, player.pos.y - scheduledMovement.y }, (Vector2){ 0.29, -0.29 })))
-      canMoveX = 0;
+    playerDead = 1;
+    gamePaused = 1;
   }
-  if (*getTile(Vector2Add(player.pos, (Vector2){ 0.29, 0 })))
-    canMoveX = false;
-  else
+  // Add new zombies while there is room for them
+  int zombiesToPlace = rngRange(&spawnRng, 1, tickRate) / tickRate;
+  // Try to spawn 4 zombies every half second
+  int tileZombies = (rngRange(&spawnRng, 1, tickRate) / tickRate) * 4;
+  for (; zombiesToPlace && horde.count < horde.capacity; zombiesToPlace--)
   {
-    if (*getTile(Vector2Add((Vector2){ player.pos.x, player.pos.y - scheduledMovement.y }, (Vector2){ -0.29, 0.29 })))
-      canMoveX = 0;
-    if (*getTile(Vector2Add((Vector2){ player.pos.x, player.pos.y - scheduledMovement.y }, (Vector2){ 0.29, 0.29 })))
-      canMoveX = 0;
+    float distance = TILESONSCREEN + rngRange(&spawnRng, 0, 5);
+    Vector2 pos = Vector2Add(player.pos, Vector2Rotate((Vector2){ distance, 0 }, rngFloat(&spawnRng) * 2 * PI));
+    // Don't come out of a wall
+    if (anySolid(&pos, 1))
+      pos = nearestSpawnPoint(pos);
+    hordeSpawn(&horde, pos);
   }
+  for (; tileZombies && horde.count < horde.capacity; tileZombies--)
+    if (spawnLocations[tileZombies-1].x != 0)
+      hordeSpawn(&horde, spawnLocations[tileZombies-1]);
+
+  profileEnd(PROFILE_ZOMBIES);
+
+  // Push apart zombies that are touching, only looking in the neighbouring
+  // cells. Everyone reads this tick's positions and writes the next ones, so
+  // the result doesn't depend on the order or the number of threads. Only
+  // the zombies moved this tick are pushed, but by everyone.
+  profileBegin(PROFILE_SEPARATION);
+  gridBuild(&zombieGrid, horde.count, horde.x, horde.y);
+  lodRun(separateBatch, NULL);
+  for (int s = 0; s < lodSliceCount; ++s)
+    hordeCommitRange(&horde, lodSlices[s].begin, lodSlices[s].end);
+  profileEnd(PROFILE_SEPARATION);
+
+  profileBegin(PROFILE_COLLISION);
+  // The window follows the tile the player started the tick on
+  struct tileCoord playerTile = tileFromPos(player.pos);
+
+  // Perform check to see if player can move to tile (Check collision)
+  player.pos = Vector2Add(player.pos, scheduledMovement);
+  // Moving up or down is blocked by the tiles above and below, or by the
+  // corners if only the vertical part of the move is made. Same for sideways.
+  Vector2 oldX = { player.pos.x - scheduledMovement.x, player.pos.y };
+  Vector2 oldY = { player.pos.x, player.pos.y - scheduledMovement.y };
+  Vector2 yPoints[6] = {
+    Vector2Add(player.pos, (Vector2){ 0, -0.29 }),
+    Vector2Add(oldX, (Vector2){ -0.29, -0.29 }),
+    Vector2Add(oldX, (Vector2){ -0.29, 0.29 }),
+    Vector2Add(player.pos, (Vector2){ 0, 0.29 }),
+    Vector2Add(oldX, (Vector2){ 0.29, -0.29 }),
+    Vector2Add(oldX, (Vector2){ 0.29, 0.29 }),
+  };
+  Vector2 xPoints[6] = {
+    Vector2Add(player.pos, (Vector2){ -0.29, 0 }),
+    Vector2Add(oldY, (Vector2){ -0.29, -0.29 }),
+    Vector2Add(oldY, (Vector2){ 0.29, -0.29 }),
+    Vector2Add(player.pos, (Vector2){ 0.29, 0 }),
+    Vector2Add(oldY, (Vector2){ -0.29, 0.29 }),
+    Vector2Add(oldY, (Vector2){ 0.29, 0.29 }),
+  };
+  int canMoveY = !anySolid(yPoints, 6);
+  int canMoveX = !anySolid(xPoints, 6);
   // printf("%d, %d\n", canMoveX, canMoveY);
 
   /* Legacy useless shit code that was create at 3 am
@@ -435,7 +1265,7 @@ int tick()
     // (Vector2){ -0.31, 0 },
   };
   for (int dir = 0; dir < 4; ++dir)
-    if (*getTile(Vector2Add(checkDirections[dir], player.pos)) == 1)
+    if (anySolid((Vector2[]){ Vector2Add(checkDirections[dir], player.pos) }, 1))
     {
       Vector2 pTileMid = Vector2Add(checkDirections[dir], (Vector2){ px + 0.5f, py + 0.5f });
       Vector2 diff = Vector2Subtract(player.pos, pTileMid);
@@ -454,79 +1284,80 @@ int tick()
   */
   if (!canMoveX) player.pos.x -= scheduledMovement.x;
   if (!canMoveY) player.pos.y -= scheduledMovement.y;
+  profileEnd(PROFILE_COLLISION);
 
-  // Load more chunks in the correct direction
-  // Check if the player is near the edge of a chunk and 'shift' the active chunks
-  int slot1, slot2;
-  // Check if we need to load chunks to the right
-  if (offsetx > CHUNKSIZE - WIDECHUNKS / 2 && activeChunkExistsX == -1)
-  {
-    printf("activeChunkExists: %d %d\n", activeChunkExistsX, activeChunkExistsY);
-    printf("Loading chunks to the right, offsetx: %d\n", offsetx);
-    // Save chunks at the left (unactivate them)
-    slot1 = findChunk(4, activeChunks, chunkx - 1, chunky, 0);
-    slot2 = findChunk(4, activeChunks, chunkx - 1, chunky + activeChunkExistsY, 0);
-    printf("slots %d %d\n", slot1, slot2);
-    saveActiveChunk(slot1);
-    saveActiveChunk(slot2);
-    // Load chunks on the right
-    loadChunk(slot1, chunkx + 1, chunky);
-    loadChunk(slot2, chunkx + 1, chunky + activeChunkExistsY);
-    activeChunkExistsX = 1;
-  }
-  // Check if we need to load chunks to the left
-  else if (offsetx < WIDECHUNKS / 2 && activeChunkExistsX == 1)
-  {
-    printf("activeChunkExists: %d %d\n", activeChunkExistsX, activeChunkExistsY);
-    printf("Loading chunks to the left, offsetx: %d\n", offsetx);
-    // Save chunks at the right (unactivate them)
-    slot1 = findChunk(4, activeChunks, chunkx + 1, chunky, 0);
-    slot2 = findChunk(4, activeChunks, chunkx + 1, chunky + activeChunkExistsY, 0);
-    printf("slots %d %d\n", slot1, slot2);
-    saveActiveChunk(slot1);
-    saveActiveChunk(slot2);
-    // Load chunks on the left
-    loadChunk(slot1, chunkx - 1, chunky);
-    loadChunk(slot2, chunkx - 1, chunky + activeChunkExistsY);
-    activeChunkExistsX = -1;
-  }
-  // Check if we need to load chunks at the bottom
-  if (offsety > CHUNKSIZE - WIDECHUNKS / 2 && activeChunkExistsY == -1)
-  {
-    printf("activeChunkExists: %d %d\n", activeChunkExistsX, activeChunkExistsY);
-    printf("Loading chunks to the bottom, offsetx: %d\n", offsety);
-    // Save chunks at the top (unactivate them)
-    slot1 = findChunk(4, activeChunks, chunkx, chunky - 1, 0);
-    slot2 = findChunk(4, activeChunks, chunkx + activeChunkExistsX, chunky - 1, 0);
-    printf("slots %d %d\n", slot1, slot2);
-    saveActiveChunk(slot1);
-    saveActiveChunk(slot2);
-    // Load chunks on the bottom
-    loadChunk(slot1, chunkx, chunky + 1);
-    loadChunk(slot2, chunkx + activeChunkExistsX, chunky + 1);
-    activeChunkExistsY = 1;
-  }
-  // Check if we need to load chunks at the top
-  else if (offsety < WIDECHUNKS / 2 && activeChunkExistsY == 1)
-  {
-    printf("activeChunkExists: %d %d\n", activeChunkExistsX, activeChunkExistsY);
-    printf("Loading chunks to the top, offsetx: %d\n", offsety);
-    // Save chunks at the bottom (unactivate them)
-    slot1 = findChunk(4, activeChunks, chunkx, chunky + 1, 0);
-    slot2 = findChunk(4, activeChunks, chunkx + activeChunkExistsX, chunky + 1, 0);
-    printf("slots %d %d\n", slot1, slot2);
-    saveActiveChunk(slot1);
-    saveActiveChunk(slot2);
-    // Load chunks on the top
-    loadChunk(slot1, chunkx, chunky - 1);
-    loadChunk(slot2, chunkx + activeChunkExistsX, chunky - 1);
-    activeChunkExistsY = -1;
-  }
+  profileBegin(PROFILE_CHUNKS);
+  // Swap in the chunks the player is walking towards
+  recentreWindow(playerTile);
+  prefetchChunks();
+  profileEnd(PROFILE_CHUNKS);
 
   return 0;
 }
 
 
+// Work out what the next frame shows without drawing anything, so the
+// headless build can time it too: bring the baked ground up to date and
+// find the tiles and zombies that are on screen
+int prepareFrame()
+{
+  profileBegin(PROFILE_TILES);
+  int tileSize = sH / (float) TILESONSCREEN;
+  tilesVisible = 0;
+  tilesCulled = activeCount * CHUNKSIZE * CHUNKSIZE;
+  // A wider window can show more chunks than there are bakes yet
+  int shown = 0;
+  for (int c = 0; c < activeCount; ++c)
+    shown += chunkShown[c] = chunkVisibleRange(activeChunks[c], viewPos, tileSize, chunkRanges[c]);
+  bakeReserve(shown);
+  // Chunks on screen that still have a bake keep it, then the rest take
+  // the ones that went off screen
+  static unsigned int bakeStamp;
+  ++bakeStamp;
+  for (int c = 0; c < activeCount; ++c)
+  {
+    int x = activeChunks[c]->pos.x, y = activeChunks[c]->pos.y;
+    chunkBakes[c] = chunkShown[c] && bakeFind(x, y) ? bakeTake(x, y, bakeStamp) : NULL;
+  }
+  int bakeBudget = BAKEBUDGET;
+  for (int c = 0; c < activeCount; ++c)
+  {
+    if (!chunkShown[c])
+      continue;
+    if (!chunkBakes[c])
+      chunkBakes[c] = bakeTake(activeChunks[c]->pos.x, activeChunks[c]->pos.y, bakeStamp);
+    // Catch up on the tiles in view that changed or are new to the bake,
+    // there is none only if the pool couldn't grow
+    if (chunkBakes[c])
+      bakeBudget -= bakeUpdate(chunkBakes[c], activeChunks[c], worldSeed, chunkRanges[c], bakeBudget);
+    int w = chunkRanges[c][1] - chunkRanges[c][0], h = chunkRanges[c][3] - chunkRanges[c][2];
+    tilesVisible += w * h;
+    tilesCulled -= w * h;
+  }
+
+  profileEnd(PROFILE_TILES);
+
+  // A zombie's sprite covers -0.4 to 0.6 tiles across its position and
+  // -0.5 to 0.5 down, skip the ones that don't reach the screen
+  profileBegin(PROFILE_SPRITES);
+  float ftileSize = sH / (float) TILESONSCREEN;
+  float halfW = sW * 0.5f / (ftileSize * mainCam.zoom), halfH = sH * 0.5f / (ftileSize * mainCam.zoom);
+  float left = viewPos.x - halfW - 0.6f, right = viewPos.x + halfW + 0.4f;
+  float top = viewPos.y - halfH - 0.5f, bottom = viewPos.y + halfH + 0.5f;
+  zombiesVisible = 0;
+  for (int i = 0; i < horde.count; ++i)
+  {
+    Vector2 zom = hordeLerpPos(&horde, i, tickAlpha);
+    if (zom.x < left || zom.x > right || zom.y < top || zom.y > bottom)
+      continue;
+    zombiesShown[zombiesVisible++] = i;
+  }
+  zombiesCulled = horde.count - zombiesVisible;
+  profileEnd(PROFILE_SPRITES);
+  return 0;
+}
+
+#ifndef HEADLESS
 int drawGame()
 {
   // Check the resolution of the window in case it has been resized
@@ -543,43 +1374,30 @@ int drawGame()
   mainCam.offset.y = sH / 2.f;
   // Calculate size of tiles
   int tileSize = sH / (float) TILESONSCREEN;
-  // Overdraw tiles to prevent gaps
-  float otileSize = tileSize * 1.1f;
 
   #ifdef debug
-  for (int c = 0; c < 4; ++c)
-    DrawRectangleLines(activeChunks[c].pos.x * tileSize * CHUNKSIZE, activeChunks[c].pos.y * tileSize * CHUNKSIZE, tileSize * CHUNKSIZE, tileSize * CHUNKSIZE, RED);
+  for (int c = 0; c < activeCount; ++c)
+    DrawRectangleLines(activeChunks[c]->pos.x * tileSize * CHUNKSIZE, activeChunks[c]->pos.y * tileSize * CHUNKSIZE, tileSize * CHUNKSIZE, tileSize * CHUNKSIZE, RED);
   #endif /* ifdef debug */
-  // Draw active chunks
-  Rectangle tileRect;
-  for (int c = 0; c < 4; ++c)
-    for (int x = 0; x < CHUNKSIZE; ++x)
-      for (int y = 0; y < CHUNKSIZE; ++y)
-      {
-        Vector2 realPos = {
-          x + CHUNKSIZE * activeChunks[c].pos.x,
-          y + CHUNKSIZE * activeChunks[c].pos.y,
-        };
-        Vector2 screenPos = {
-          realPos.x + -1.f * player.pos.x + 0.0000001f,
-          realPos.y + -1.f * player.pos.y + 0.0000001f,
-        };
-        int pixelPosX = screenPos.x * tileSize;
-        int pixelPosY = screenPos.y * tileSize;
-        if (pixelPosX > sW * 0.5 || pixelPosX < sW * -0.55)
-          continue;
-        if (pixelPosY > sH * 0.5 || pixelPosY < sH * -0.55)
-          continue;
-        Color col = { 0, 128, 45, 255};
-        col.g = 128 + 4 * (randoms[x][y] % 3);
-        col.g *= 1 - activeChunks[c].tiles[x][y];
-        col.r = 200 * activeChunks[c].tiles[x][y];
-        #ifdef debug
-        if ((!x || x == 127) && (!y || y == 127)) col = RAYWHITE;
-        #endif /* ifdef debug */
-        DrawTextureEx(grassTex, (Vector2){ pixelPosX, pixelPosY }, 0.f, otileSize / 40.f, col);
-        // DrawText(TextFormat("%d %d", (int) activeChunks[c].pos.x, (int) activeChunks[c].pos.y), screenPos.x * tileSize, screenPos.y * tileSize, tileSize / 5, RED);
-      }
+  prepareFrame();
+  // Draw the on screen part of each active chunk's baked ground
+  profileBegin(PROFILE_TILES);
+  for (int c = 0; c < activeCount; ++c)
+  {
+    if (!chunkShown[c] || !chunkBakes[c])
+      continue;
+    int *range = chunkRanges[c];
+    int w = range[1] - range[0], h = range[3] - range[2];
+    Rectangle source = { range[0] * BAKETILESIZE, range[2] * BAKETILESIZE, w * BAKETILESIZE, h * BAKETILESIZE };
+    Rectangle dest = {
+      (CHUNKSIZE * activeChunks[c]->pos.x + range[0] - viewPos.x) * tileSize,
+      (CHUNKSIZE * activeChunks[c]->pos.y + range[2] - viewPos.y) * tileSize,
+      w * tileSize,
+      h * tileSize,
+    };
+    DrawTexturePro(chunkBakes[c]->texture, source, dest, (Vector2){ 0, 0 }, 0.f, WHITE);
+  }
+  profileEnd(PROFILE_TILES);
 
   // Draw gun range
   // Vector2 normalisedMouse;
@@ -613,28 +1431,38 @@ int drawGame()
   #endif /* ifdef debug */
 
   float ftileSize = sH / (float) TILESONSCREEN;
-  // Draw zombies
-  Texture2D zombieTex;
-  for (int i = 0; i < MAXZOMBIES; ++i)
-    if (zombies[i].x != 0)
-    {
-      if (zombies[i].x > player.pos.x)
-        zombieTex = zombieRightWalk[((frameCount + i * 9) % (FPS / 4)) * 8 / FPS];
-      else
-        zombieTex = zombieLeftWalk[((frameCount + i * 9) % (FPS / 4)) * 8 / FPS];
-      DrawTextureEx(zombieTex, Vector2Add(Vector2Scale(Vector2Subtract(zombies[i], player.pos), ftileSize), (Vector2){ ftileSize * -0.4, ftileSize * -0.5 }), 0.f, ftileSize / 8.0f, WHITE);
-      #ifdef debug
-      float angle = Vector2Angle(Vector2Subtract(normalisedMouse, player.pos), Vector2Subtract(zombies[i], player.pos));
-      if (Vector2Distance(zombies[i], player.pos) <= 3)
-      {
-        // float angle = Vector2Angle(Vector2Subtract(normalisedMouse, player.pos), Vector2Subtract(zombies[i], player.pos));
-        if (angle > -0.785398 && angle < 0.785398) DrawCircleV(Vector2Scale(Vector2Subtract(zombies[i], player.pos), tileSize), tileSize * 0.3, RED);
-        else DrawCircleV(Vector2Scale(Vector2Subtract(zombies[i], player.pos), tileSize), tileSize * 0.3, PURPLE);
-      }
-      Vector2 tpos = Vector2Scale(Vector2Subtract(zombies[i], player.pos), tileSize);
-      DrawText(TextFormat("%f", zombies[i].x), tpos.x, tpos.y, 20, RED);
-      #endif /* ifdef debug */
+  // Draw the zombies on screen. Every one goes into one stream of quads from
+  // the atlas, so the whole horde is a single draw call (or one per few
+  // thousand zombies).
+  profileBegin(PROFILE_SPRITES);
+  Vector2 zom;
+  atlasBegin(&sprites);
+  for (int k = 0; k < zombiesVisible; ++k)
+  {
+    int i = zombiesShown[k];
+    zom = hordeLerpPos(&horde, i, tickAlpha);
+    // Step in time by handle, indices change when zombies die
+    int phase = ((frameCount + (horde.handle[i] & HANDLESLOTMASK) * 9) % (tickRate / 4)) * 8 / tickRate;
+    int sprite = (zom.x > viewPos.x ? SPRITE_ZOMBIERIGHTWALK1 : SPRITE_ZOMBIELEFTWALK1) + phase;
+    Vector2 corner = Vector2Scale(Vector2Subtract(zom, viewPos), ftileSize);
+    atlasQuad(&sprites, sprite, (Rectangle){ corner.x - ftileSize * 0.4f, corner.y - ftileSize * 0.5f, ftileSize, ftileSize });
+  }
+  atlasEnd();
+  #ifdef debug
+  for (int i = 0; i < horde.count; ++i)
+  {
+    zom = hordeLerpPos(&horde, i, tickAlpha);
+    float angle = Vector2Angle(Vector2Subtract(normalisedMouse, viewPos), Vector2Subtract(zom, viewPos));
+    if (Vector2Distance(zom, viewPos) <= 3)
+    {
+      // float angle = Vector2Angle(Vector2Subtract(normalisedMouse, viewPos), Vector2Subtract(zom, viewPos));
+      if (angle > -0.785398 && angle < 0.785398) DrawCircleV(Vector2Scale(Vector2Subtract(zom, viewPos), tileSize), tileSize * 0.3, RED);
+      else DrawCircleV(Vector2Scale(Vector2Subtract(zom, viewPos), tileSize), tileSize * 0.3, PURPLE);
     }
+    Vector2 tpos = Vector2Scale(Vector2Subtract(zom, viewPos), tileSize);
+    DrawText(TextFormat("%f", zom.x), tpos.x, tpos.y, 20, RED);
+  }
+  #endif /* ifdef debug */
 
   // Draw player
   // DrawRectangle(ftileSize * -0.3, ftileSize * -0.3, ftileSize * 0.6, ftileSize * 0.6, BLUE);
@@ -645,15 +1473,15 @@ int drawGame()
   
   // Anime player
   // DrawTextureRec(manLeft, (Rectangle){ 0, 0, ftileSize * 06, ftileSize * 06 }, (Vector2){ ftileSize * -03, ftileSize * -03}, (Color){ 128, 128, 128, 255 });
-  Texture2D manTex = facing?manLeft:manRight;
+  int manSprite = facing ? SPRITE_MANLEFT : SPRITE_MANRIGHT;
   if (scheduledMovement.x != 0.f || scheduledMovement.y != 0.f)
   {
-    if (facing)
-      manTex = manLeftWalk[((frameCount + 69) % (FPS / 5)) * 10 / FPS];
-    else
-      manTex = manRightWalk[((frameCount + 69) % (FPS / 5)) * 10 / FPS];
+    int phase = ((frameCount + 69) % (tickRate / 5)) * 10 / tickRate;
+    manSprite = (facing ? SPRITE_MANLEFTWALK1 : SPRITE_MANRIGHTWALK1) + phase;
   }
-  DrawTextureEx(manTex, (Vector2){ ftileSize * -0.5, ftileSize * -0.5}, 0.f, ftileSize / 8.f, WHITE);
+  // Same texture as the horde, so this joins the zombies' batch
+  atlasDraw(&sprites, manSprite, (Vector2){ ftileSize * -0.5, ftileSize * -0.5}, ftileSize / 8.f);
+  profileEnd(PROFILE_SPRITES);
 
   // Subtract 45 degrees
   Vector2 v1 = Vector2Rotate((Vector2){ tileSize * 1.f, tileSize * 0.4 }, mouseAngle + 0.785398);
@@ -668,16 +1496,13 @@ int drawGame()
 int drawUI()
 {
   #ifdef debug
-  int px = player.pos.x > 0 ? (int) player.pos.x : (int) player.pos.x - 1;
-  int py = player.pos.y > 0 ? (int) player.pos.y : (int) player.pos.y - 1;
-  py++;
-  if (px < 10) px++;
-  DrawText(TextFormat("Pos: %d, %d | Raw Pos: %f %f", px, py, player.pos.x, player.pos.y), 10, 10, 20, RED);
-  int pCx = px > 0 ? (int) px / 128 : (int) px / 128 - 1;
-  int pCy = py > 0 ? (int) py / 128 : (int) py-- / 128 - 1;
-  DrawText(TextFormat("Chunk: %d, %d", pCx, pCy), 10, 40, 20, RED);
-  DrawText(TextFormat("Chunk offset: %d, %d", (unsigned int)(px-1) % 128, (unsigned int)(py-1) % 128), 10, 70, 20, RED);
-  DrawText(TextFormat("aCE: %d, %d", activeChunkExistsX, activeChunkExistsY), 10, 100, 20, RED);
+  struct tileCoord t = tileFromPos(player.pos);
+  DrawText(TextFormat("Pos: %d, %d | Raw Pos: %f %f", t.x, t.y, player.pos.x, player.pos.y), 10, 10, 20, RED);
+  DrawText(TextFormat("Chunk: %d, %d", TILECHUNK(t.x), TILECHUNK(t.y)), 10, 40, 20, RED);
+  DrawText(TextFormat("Chunk offset: %d, %d", TILELOCAL(t.x), TILELOCAL(t.y)), 10, 70, 20, RED);
+  DrawText(TextFormat("Window: %d, %d, radius %d", activeOriginX, activeOriginY, activeRadius), 10, 100, 20, RED);
+  DrawText(TextFormat("Tiles drawn: %d culled: %d", tilesVisible, tilesCulled), 10, 130, 20, RED);
+  DrawText(TextFormat("Zombies drawn: %d culled: %d", zombiesVisible, zombiesCulled), 10, 160, 20, RED);
   #endif /* ifdef debug */
   // Pause border to easily see that game is paused
   if (gamePaused) DrawRectangleLinesEx((Rectangle){ 0, 0, sW, sH }, 20, (Color){ 230, 41, 55, 128 });
@@ -739,72 +1564,779 @@ int drawScreen(int screen)
     break;
 
 } return 0; }
+#endif /* ifndef HEADLESS */
+
 
+// The slot a chunk has while it is in the window
+int activeSlot(int xPos, int yPos)
+{
+  int x = xPos % activeSide, y = yPos % activeSide;
+  if (x < 0) x += activeSide;
+  if (y < 0) y += activeSide;
+  return y * activeSide + x;
+}
+
+// Get the slot of the active chunk at the given chunk coordinates, or -1
+int findActiveChunk(int xPos, int yPos)
+{
+  // Unsigned so one compare also catches coordinates below the origin
+  unsigned int dx = xPos - activeOriginX, dy = yPos - activeOriginY;
+  if (dx >= (unsigned int) activeSide || dy >= (unsigned int) activeSide)
+    return -1;
+  return activeSlot(xPos, yPos);
+}
+
+// Hand a chunk from the active list over to be put in the chunk cache
+int saveActiveChunk(int slot)
+{
+  if (slot == -1 || !activeChunks[slot]) return -1;
+  streamStore(&chunkStream, activeChunks[slot]);
+  activeChunks[slot] = NULL;
+  return 0;
+}
+
+// Make a chunk active, it is usually loaded already thanks to
+// prefetchChunks, if not this waits for it
+int loadChunk(int slot, int xPos, int yPos)
+{
+  if (slot == -1) return -1;
+  // Its bake, if it still has one, is still good: it couldn't be changed
+  // while it was away
+  activeChunks[slot] = streamTake(&chunkStream, xPos, yPos);
+  return 0;
+}
 
-int xorShift32(int state)
+// Where the window's centre chunk should be along one axis for a player on
+// tile t, it stays at centre until they are RECENTRESLACK tiles past it
+static int windowCentre(int t, int centre)
 {
-  int x = state;
-  for (int i = 0; i < 83; ++i)
+  if (t >= (centre + 1) * CHUNKSIZE + RECENTRESLACK || t < centre * CHUNKSIZE - RECENTRESLACK)
+    return TILECHUNK(t);
+  return centre;
+}
+
+// Move the window a chunk along x or y (dx or dy is 1 or -1). The chunks
+// leaving and the ones coming in are a side apart, so they share slots and
+// nothing else in the window moves.
+static int shiftWindow(int dx, int dy)
+{
+  logMessage(LOGLEVEL_DEBUG, "Moving the window by %d, %d from %d, %d", dx, dy, activeOriginX, activeOriginY);
+  int leaveX = dx > 0 ? activeOriginX : activeOriginX + activeSide - 1;
+  int leaveY = dy > 0 ? activeOriginY : activeOriginY + activeSide - 1;
+  for (int i = 0; i < activeSide; ++i)
   {
-    x ^= x << 13;
-    x ^= x >> 17;
-    x ^= x << 5;
-    x++;
+    int x = dx ? leaveX : activeOriginX + i;
+    int y = dy ? leaveY : activeOriginY + i;
+    int slot = activeSlot(x, y);
+    saveActiveChunk(slot);
+    loadChunk(slot, x + dx * activeSide, y + dy * activeSide);
   }
-  return x;
+  activeOriginX += dx;
+  activeOriginY += dy;
+  return 0;
 }
 
-int findChunk(int length, struct mapChunk searchlist[length], int xPos, int yPos, int flags)
+// Move the window a row or column at a time until it is centred on the
+// player's chunk, however wide it is only the edges change
+int recentreWindow(struct tileCoord playerTile)
 {
-  for (int i = 0; i < length; ++i)
-    if ((int) searchlist[i].pos.x == xPos && (int) searchlist[i].pos.y == yPos)
-      if (!(flags & 1) || openSlots[i] != -1)
-        return i;
-  return -1;
+  int centreX = activeOriginX + activeRadius, centreY = activeOriginY + activeRadius;
+  int toX = windowCentre(playerTile.x, centreX), toY = windowCentre(playerTile.y, centreY);
+  for (; centreX != toX; centreX += toX > centreX ? 1 : -1)
+    shiftWindow(toX > centreX ? 1 : -1, 0);
+  for (; centreY != toY; centreY += toY > centreY ? 1 : -1)
+    shiftWindow(0, toY > centreY ? 1 : -1);
+  return 0;
 }
 
-// Save a chunk in the active chunk list to the chunk cache
-int saveActiveChunk(int slot)
+// Start loading the chunks that will be active where the player is headed,
+// from how far they moved this tick, so they are ready by the time the
+// window moves onto them. Only where the loading happens changes, the
+// chunks that end up active are the same, so the game plays out the same
+// either way.
+int prefetchChunks()
+{
+  Vector2 velocity = Vector2Subtract(player.pos, prevPlayerPos);
+  if (velocity.x == 0 && velocity.y == 0)
+    return 0;
+  struct tileCoord ahead = tileFromPos(Vector2Add(player.pos, Vector2Scale(velocity, STREAMLOOKAHEAD * tickRate)));
+  // Only look one step ahead, there's only room to keep a row and a column
+  int centreX = activeOriginX + activeRadius, centreY = activeOriginY + activeRadius;
+  int stepX = windowCentre(ahead.x, centreX) - centreX, stepY = windowCentre(ahead.y, centreY) - centreY;
+  stepX = stepX > 1 ? 1 : stepX < -1 ? -1 : stepX;
+  stepY = stepY > 1 ? 1 : stepY < -1 ? -1 : stepY;
+  if (!stepX && !stepY)
+    return 0;
+  for (int y = activeOriginY + stepY; y < activeOriginY + stepY + activeSide; ++y)
+    for (int x = activeOriginX + stepX; x < activeOriginX + stepX + activeSide; ++x)
+      if (findActiveChunk(x, y) == -1)
+        streamPrefetch(&chunkStream, x, y);
+  return 0;
+}
+
+// Chunks leaving the cache go to disk instead of being lost, this runs on
+// the streaming thread
+static int evictToDisk(const struct cachedChunk *chunk, void *store)
+{
+  if (regionSave(store, chunk->x, chunk->y, chunk->data, chunk->length))
+  {
+    logMessage(LOGLEVEL_ERROR, "Could not save chunk: %d, %d", chunk->x, chunk->y);
+    return -1;
+  }
+  return 0;
+}
+
+// Handle the command line options both builds take, for the world, the
+// seed, recording, tracing, save-states and spectating. Returns 1 if argv[*i] was one of them, 0 if
+// it wasn't and -1 if its value was bad.
+int worldArg(int argc, char *argv[], int *i)
 {
-  // Iterate over chunk list and replace the oldest chunk
-  int oldest = 0;
-  for (int i = 0; i < MAXCHUNKS; ++i)
+  if (*i + 1 >= argc)
+    return 0;
+  if (!strcmp(argv[*i], "--world"))
+    worldDir = argv[++*i];
+  else if (!strcmp(argv[*i], "--record"))
+    recordPath = argv[++*i];
+  else if (!strcmp(argv[*i], "--trace"))
+  {
+    tracePath = argv[++*i];
+    profileTraceStart();
+  }
+  else if (!strcmp(argv[*i], "--log-level"))
   {
-    if (openSlots[i] > openSlots[oldest])
-      oldest = i;
-    if (openSlots[i] != -1)
-      openSlots[i]++;
+    int level = logLevelFromName(argv[++*i]);
+    if (level == -1)
+    {
+      fprintf(stderr, "Unknown log level: %s (debug, info, warn, error, none)\n", argv[*i]);
+      return -1;
+    }
+    logSetLevel(level);
   }
-  // Copy over the oldest chunk
-  openSlots[oldest] = 0;
+  else if (!strcmp(argv[*i], "--save-state"))
+    saveStatePath = argv[++*i];
+  else if (!strcmp(argv[*i], "--load-state"))
+    loadStatePath = argv[++*i];
+  else if (!strcmp(argv[*i], "--broadcast"))
+    broadcastTarget = argv[++*i];
+  else if (!strcmp(argv[*i], "--spectate"))
+    spectateSource = argv[++*i];
+  else if (!strcmp(argv[*i], "--seed"))
+    worldSeed = strtoul(argv[++*i], NULL, 10);
+  else if (!strcmp(argv[*i], "--chunk-memory"))
+    chunkMemory = atof(argv[++*i]) * 1048576;
+  else if (!strcmp(argv[*i], "--view-radius"))
+  {
+    activeRadius = atoi(argv[++*i]);
+    // The flow field needs the chunks around the middle one
+    if (activeRadius < 1 || activeRadius > ACTIVERADIUSMAX)
+    {
+      fprintf(stderr, "View radius has to be from 1 to %d\n", ACTIVERADIUSMAX);
+      return -1;
+    }
+  }
+  else if (!strcmp(argv[*i], "--flush"))
+  {
+    const char *names[] = { "never", "async", "sync" };
+    ++*i;
+    for (flushPolicy = 2; flushPolicy >= 0; --flushPolicy)
+      if (!strcmp(argv[*i], names[flushPolicy])) break;
+    if (flushPolicy == -1)
+    {
+      fprintf(stderr, "Unknown flush policy: %s (never, async, sync)\n", argv[*i]);
+      return -1;
+    }
+  }
+  else
+    return 0;
+  return 1;
+}
+
+// Make the horde and everything sized by it hold capacity zombies
+int setupHorde(int capacity)
+{
+  hordeFree(&horde);
+  gridFree(&zombieGrid);
+  free(inRange);
+  free(zombiesShown);
+  inRange = malloc(sizeof(int) * capacity);
+  zombiesShown = malloc(sizeof(int) * capacity);
+  if (hordeInit(&horde, capacity) || gridInit(&zombieGrid, ZOMBIERADIUS, capacity) || !inRange || !zombiesShown)
+  {
+    fprintf(stderr, "Not enough memory for %d zombies\n", capacity);
+    return -1;
+  }
+  return 0;
+}
+
+// Make room for every active chunk at the current radius
+int setupActiveChunks()
+{
+  activeSide = 2 * activeRadius + 1;
+  activeCount = activeSide * activeSide;
+  activeChunks = calloc(activeCount, sizeof(*activeChunks));
+  chunkBakes = calloc(activeCount, sizeof(*chunkBakes));
+  chunkShown = calloc(activeCount, sizeof(*chunkShown));
+  chunkRanges = calloc(activeCount, sizeof(*chunkRanges));
+  if (!activeChunks || !chunkBakes || !chunkShown || !chunkRanges)
+    return -1;
+  return 0;
+}
+
+int openWorld()
+{
+  // The pool holds the chunks loaded ahead as well as the active ones
+  if (setupActiveChunks() || cacheInit(&chunkCache, chunkMemory, activeCount + STREAMREADY))
+  {
+    fprintf(stderr, "Not enough memory for the active chunks\n");
+    return -1;
+  }
+  if (regionOpen(&regionStore, worldDir, flushPolicy))
+  {
+    fprintf(stderr, "Could not open world directory: %s\n", worldDir ? worldDir : regionStore.dir);
+    return -1;
+  }
+  if (worldDir)
+    logMessage(LOGLEVEL_INFO, "Region files go in %s", regionStore.dir);
+  chunkCache.onEvict = evictToDisk;
+  chunkCache.evictUser = &regionStore;
+  streamInit(&chunkStream, &chunkCache, &regionStore);
+  return 0;
+}
+
+// Run a tick with the given input, recording it if asked to
+int stepGame(const struct tickInput *in)
+{
+  profileBegin(PROFILE_INPUT);
+  applyInput(in);
+  profileEnd(PROFILE_INPUT);
+  tick();
+  if (recorder.file)
+    replayWriteTick(&recorder, in, stateChecksum());
+  if (broadcastTarget)
+    broadcastView();
+  return 0;
+}
+
+// Everything a tick changes that later ticks depend on, to catch a replay
+// going differently to how it was recorded
+uint32_t stateChecksum()
+{
+  uint32_t hash = 2166136261u;
+  int state[4] = { player.kills, playerDead, horde.count, 0 };
+  float values[4] = { player.pos.x, player.pos.y, shotgunCooldown, 0 };
+  hash = replayHash(hash, state, sizeof(state));
+  hash = replayHash(hash, values, sizeof(values));
+  hash = replayHash(hash, horde.x, sizeof(float) * horde.count);
+  hash = replayHash(hash, horde.y, sizeof(float) * horde.count);
+  return replayHash(hash, &editedHash, sizeof(editedHash));
+}
+
+// One tile's part of editedHash, they are XORed together so a tile can be
+// taken out and put back in when it changes
+static uint32_t tileHash(int x, int y, char value)
+{
+  int tile[3] = { x, y, value };
+  return value ? replayHash(2166136261u, tile, sizeof(tile)) : 0;
+}
+
+uint32_t chunkTilesHash(const struct mapChunk *chunk)
+{
+  uint32_t hash = 0;
+  int originX = CHUNKSIZE * (int) chunk->pos.x, originY = CHUNKSIZE * (int) chunk->pos.y;
   for (int x = 0; x < CHUNKSIZE; ++x)
     for (int y = 0; y < CHUNKSIZE; ++y)
-      chunks[oldest].tiles[x][y] = activeChunks[slot].tiles[x][y];
-  chunks[oldest].pos = activeChunks[slot].pos;
-  
-  printf("Chunk saved to index %d\n", oldest);
+      hash ^= tileHash(originX + x, originY + y, chunk->tiles[x][y]);
+  return hash;
+}
+
+static int hashPackedChunk(int x, int y, const unsigned char *data, int length)
+{
+  static struct mapChunk chunk;
+  chunk.pos = (Vector2){ x, y };
+  if (!chunkUnpack(&chunk, data, length))
+    editedHash ^= chunkTilesHash(&chunk);
   return 0;
 }
 
-// Load a chunk from chunk cache, if it does not exist, create an empty chunk
-int loadChunk(int slot, int xPos, int yPos)
+static int hashCachedChunk(const struct cachedChunk *chunk, void *user)
+{
+  (void) user;
+  return hashPackedChunk(chunk->x, chunk->y, chunk->data, chunk->length);
+}
+
+static int hashStoredChunk(int x, int y, const unsigned char *data, int length, void *user)
+{
+  (void) user;
+  // The window and the cache have newer copies of chunks that were loaded
+  // back from disk
+  int inWindow = x >= activeOriginX && x < activeOriginX + activeSide && y >= activeOriginY && y < activeOriginY + activeSide;
+  if (inWindow || cacheHas(&chunkCache, x, y))
+    return 0;
+  return hashPackedChunk(x, y, data, length);
+}
+
+// Work editedHash out from every edited chunk there is
+uint32_t worldTilesHash()
+{
+  streamWait(&chunkStream);
+  editedHash = 0;
+  for (int c = 0; c < activeCount; ++c)
+    if (activeChunks[c]->edited)
+      editedHash ^= chunkTilesHash(activeChunks[c]);
+  cacheEach(&chunkCache, hashCachedChunk, NULL);
+  regionEach(&regionStore, hashStoredChunk, NULL);
+  return editedHash;
+}
+
+// Open the --record file with the settings a replay needs, zombies is how
+// many are spawned before the first tick
+int startRecording(int zombies)
+{
+  if (!recordPath)
+    return 0;
+  struct replayHeader header = { .tickRate = tickRate, .seed = worldSeed, .viewRadius = activeRadius, .zombieCapacity = horde.capacity, .zombies = zombies };
+  if (replayCreate(&recorder, recordPath, &header))
+  {
+    fprintf(stderr, "Could not record to: %s\n", recordPath);
+    return -1;
+  }
+  return 0;
+}
+
+// Write out the timed sections if --trace asked for them
+int finishTrace()
 {
-  int chunk = findChunk(MAXCHUNKS, chunks, xPos, yPos, 1);
-  if (chunk == -1)
+  if (tracePath && profileTraceWrite(tracePath))
   {
-    printf("Chunk NOT found: %d, %d\n", xPos, yPos);
-    memset(&activeChunks[slot], 0, sizeof(activeChunks[slot]));
-    activeChunks[slot].pos = (Vector2){ xPos, yPos };
+    fprintf(stderr, "Could not write trace: %s\n", tracePath);
+    return -1;
   }
+  return 0;
+}
+
+// A packed chunk for a save-state, behind a 1 so the list can end with a 0
+static int writeStoredChunk(int x, int y, const unsigned char *data, int length, void *user)
+{
+  struct snapWriter *w = user;
+  snapPut(w, "\1", 1);
+  snapPutSigned(w, x);
+  snapPutSigned(w, y);
+  snapPutVarint(w, length);
+  return snapPut(w, data, length);
+}
+
+// Cached chunks are written oldest first, so putting them back in order
+// gives the same cache
+static int writeCachedChunk(const struct cachedChunk *chunk, void *user)
+{
+  return writeStoredChunk(chunk->x, chunk->y, chunk->data, chunk->length, user);
+}
+
+// Read the next chunk written by writeStoredChunk into packed, returns its
+// length or 0 at the 0 after the last one
+static int readStoredChunk(struct snapReader *r, int *x, int *y, unsigned char *packed)
+{
+  unsigned char more;
+  if (snapGet(r, &more, 1) || !more)
+    return 0;
+  *x = snapGetSigned(r);
+  *y = snapGetSigned(r);
+  uint32_t length = snapGetVarint(r);
+  if (!length || length > CHUNKPACKMAX)
+  {
+    r->failed = 1;
+    return 0;
+  }
+  snapGet(r, packed, length);
+  return r->failed ? 0 : (int) length;
+}
+
+// Write the whole simulation out, everything the next tick reads, so
+// readState carries on exactly where this left off
+int writeState(struct snapWriter *w)
+{
+  // The cache and the store can only be looked at once streaming is done
+  streamWait(&chunkStream);
+  struct stateHeader header = { STATEMAGIC, STATEVERSION, tickRate, worldSeed, activeRadius, horde.capacity };
+  snapPut(w, &header, sizeof(header));
+  snapPutU32(w, frameCount);
+  snapPut(w, &player, sizeof(player));
+  snapPut(w, &prevPlayerPos, sizeof(prevPlayerPos));
+  int flags[4] = { playerDead, facing, mouseMode, spawnLocationsI };
+  snapPut(w, flags, sizeof(flags));
+  snapPutFloat(w, shotgunCooldown);
+  snapPut(w, &spawnRng, sizeof(spawnRng));
+  snapPut(w, spawnLocations, sizeof(spawnLocations));
+  snapPut(w, &normalisedMouse, sizeof(normalisedMouse));
+  snapPut(w, &scheduledMovement, sizeof(scheduledMovement));
+  snapPutSigned(w, activeOriginX);
+  snapPutSigned(w, activeOriginY);
+  // Chunks nobody changed are made again from the seed
+  unsigned char packed[CHUNKPACKMAX];
+  for (int y = activeOriginY; y < activeOriginY + activeSide; ++y)
+    for (int x = activeOriginX; x < activeOriginX + activeSide; ++x)
+    {
+      const struct mapChunk *chunk = activeChunks[activeSlot(x, y)];
+      snapPut(w, &chunk->edited, 1);
+      if (!chunk->edited)
+        continue;
+      int length = chunkPack(chunk, packed);
+      snapPutVarint(w, length);
+      snapPut(w, packed, length);
+    }
+  // Then the ones on disk and the cached ones, each behind a 1, and a 0 after
+  regionEach(&regionStore, writeStoredChunk, w);
+  snapPut(w, "", 1);
+  cacheEach(&chunkCache, writeCachedChunk, w);
+  snapPut(w, "", 1);
+  hordeWrite(&horde, w);
+  for (int b = 0; b < LODBANDS; ++b)
+    snapPutVarint(w, lodEnds[b]);
+  flowWrite(&flow, w);
+  return w->failed ? -1 : 0;
+}
+
+// Check the header a save-state or a spectator's keyframe starts with
+static int readStateHeader(struct snapReader *r, struct stateHeader *header, const char *magic)
+{
+  if (snapGet(r, header, sizeof(*header)) || memcmp(header->magic, magic, 4) || header->version != STATEVERSION ||
+      header->viewRadius < 1 || header->viewRadius > ACTIVERADIUSMAX || !header->zombieCapacity || header->zombieCapacity > HORDELIMIT)
+    return -1;
+  return 0;
+}
+
+// Play with the settings from a header, before the world is opened since
+// the view radius sizes it
+int stateSettings(const struct stateHeader *header)
+{
+  setTickRate(header->tickRate);
+  worldSeed = header->seed;
+  activeRadius = header->viewRadius;
+  zombieCapacity = header->zombieCapacity;
+  return 0;
+}
+
+// Take the settings from a save-state's header before the world is opened,
+// so the game it is loaded into matches
+int peekState(const char *path)
+{
+  struct stateHeader raw, header;
+  FILE *f = fopen(path, "rb");
+  int ok = f && fread(&raw, sizeof(raw), 1, f) == 1;
+  if (f)
+    fclose(f);
+  struct snapReader r = { (const unsigned char *) &raw, sizeof(raw), 0, 0 };
+  if (!ok || readStateHeader(&r, &header, STATEMAGIC))
+  {
+    fprintf(stderr, "Not a save-state: %s\n", path);
+    return -1;
+  }
+  return stateSettings(&header);
+}
+
+// Throw the running game away for the one writeState wrote. Nothing is
+// loaded from disk or worked out again except untouched chunks, so this
+// takes about as long as copying the state in.
+int readState(struct snapReader *r)
+{
+  struct stateHeader header;
+  if (readStateHeader(r, &header, STATEMAGIC))
+  {
+    logMessage(LOGLEVEL_ERROR, "Not a save-state");
+    return -1;
+  }
+  if ((int) header.viewRadius != activeRadius)
+  {
+    logMessage(LOGLEVEL_ERROR, "Save-state has a view radius of %d, this game has %d", header.viewRadius, activeRadius);
+    return -1;
+  }
+  stateSettings(&header);
+  if (zombieCapacity != horde.capacity && setupHorde(zombieCapacity))
+    return -1;
+  if (broadcastTarget && viewInit(&broadcast.view, horde.capacity))
+    return -1;
+  streamReset(&chunkStream, worldSeed);
+  cacheReset(&chunkCache);
+  regionReset(&regionStore);
+  frameCount = snapGetU32(r);
+  snapGet(r, &player, sizeof(player));
+  snapGet(r, &prevPlayerPos, sizeof(prevPlayerPos));
+  int flags[4];
+  snapGet(r, flags, sizeof(flags));
+  playerDead = flags[0];
+  facing = flags[1];
+  mouseMode = flags[2];
+  spawnLocationsI = flags[3] >= 0 && flags[3] < NUMSPAWNLOCATIONS ? flags[3] : 0;
+  shotgunCooldown = snapGetFloat(r);
+  snapGet(r, &spawnRng, sizeof(spawnRng));
+  snapGet(r, spawnLocations, sizeof(spawnLocations));
+  snapGet(r, &normalisedMouse, sizeof(normalisedMouse));
+  snapGet(r, &scheduledMovement, sizeof(scheduledMovement));
+  viewPos = prevPlayerPos;
+  activeOriginX = snapGetSigned(r);
+  activeOriginY = snapGetSigned(r);
+  unsigned char packed[CHUNKPACKMAX];
+  struct mapChunk *fresh[ACTIVESIDEMAX * ACTIVESIDEMAX];
+  int freshCount = 0;
+  bakeForgetAll();
+  for (int y = activeOriginY; y < activeOriginY + activeSide; ++y)
+    for (int x = activeOriginX; x < activeOriginX + activeSide; ++x)
+    {
+      int slot = activeSlot(x, y);
+      struct mapChunk *chunk = activeChunks[slot] = cacheNewChunk(&chunkCache, x, y);
+      unsigned char edited;
+      snapGet(r, &edited, 1);
+      if (!edited)
+      {
+        fresh[freshCount++] = chunk;
+        continue;
+      }
+      uint32_t length = snapGetVarint(r);
+      if (length > CHUNKPACKMAX || snapGet(r, packed, length) || chunkUnpack(chunk, packed, length))
+        r->failed = 1;
+      chunk->edited = 1;
+    }
+  genChunks(fresh, freshCount, worldSeed);
+  int x, y, length;
+  while ((length = readStoredChunk(r, &x, &y, packed)))
+    regionSave(&regionStore, x, y, packed, length);
+  while ((length = readStoredChunk(r, &x, &y, packed)))
+    cachePutPacked(&chunkCache, x, y, packed, length);
+  int lodBad = hordeRead(&horde, r);
+  for (int b = 0; b < LODBANDS; ++b)
+  {
+    lodEnds[b] = snapGetVarint(r);
+    lodBad |= lodEnds[b] > horde.count || lodEnds[b] < (b ? lodEnds[b - 1] : 0);
+  }
+  if (r->failed || lodBad || flowRead(&flow, r))
+  {
+    // Half a state is no use, start again instead
+    logMessage(LOGLEVEL_ERROR, "Save-state is cut short or broken");
+    setupGame();
+    return -1;
+  }
+  worldTilesHash();
+  broadcast.view.resync = 1;
+  return 0;
+}
+
+// Write a save-state to path, returns -1 if it couldn't be
+int saveState(const char *path)
+{
+  double start = clockSeconds();
+  struct snapWriter w = { 0 };
+  int err = writeState(&w) || snapSaveFile(path, &w);
+  if (err)
+    logMessage(LOGLEVEL_ERROR, "Could not save state to: %s", path);
   else
+    logMessage(LOGLEVEL_INFO, "Saved %zu bytes of state to %s in %.2f ms", w.length, path, (clockSeconds() - start) * 1000);
+  snapFree(&w);
+  return err ? -1 : 0;
+}
+
+// Carry on from a save-state written by saveState
+int loadState(const char *path)
+{
+  double start = clockSeconds();
+  struct snapWriter w = { 0 };
+  if (snapLoadFile(path, &w))
   {
-    printf("Chunk found: %d, %d\n", xPos, yPos);
-    for (int x = 0; x < CHUNKSIZE; ++x)
-      for (int y = 0; y < CHUNKSIZE; ++y)
-         activeChunks[slot].tiles[x][y] = chunks[chunk].tiles[x][y];
-    activeChunks[slot].pos = chunks[chunk].pos;
-    openSlots[chunk] = -1;
+    logMessage(LOGLEVEL_ERROR, "Could not load state from: %s", path);
+    snapFree(&w);
+    return -1;
+  }
+  struct snapReader r = { w.data, w.length, 0, 0 };
+  int err = readState(&r);
+  if (!err)
+    logMessage(LOGLEVEL_INFO, "Restored %zu bytes of state from %s in %.2f ms", w.length, path, (clockSeconds() - start) * 1000);
+  // The replay carries on from the same state, it's as big as the file
+  if (!err && recorder.file)
+    replayWriteState(&recorder, &w);
+  snapFree(&w);
+  return err;
+}
+
+// The active chunk at (x, y) for spectate.c, with swap set a blank one goes
+// in its place and the old one back to the cache
+static struct mapChunk *spectateChunk(int x, int y, int swap)
+{
+  int slot = activeSlot(x, y);
+  if (!swap)
+    return activeChunks[slot];
+  if (activeChunks[slot])
+  {
+    // Not kept, the next record brings it back if it comes back
+    activeChunks[slot]->edited = 0;
+    cachePut(&chunkCache, activeChunks[slot]);
+  }
+  bakeForget(x, y);
+  return activeChunks[slot] = cacheNewChunk(&chunkCache, x, y);
+}
+
+// How spectate.c gets at this game
+static struct spectateGame gameForSpectators()
+{
+  return (struct spectateGame){ &horde, &activeOriginX, &activeOriginY, activeSide, worldSeed, spectateChunk, activeTile, setTile };
+}
+
+// Ticks between records to spectators
+static int spectateEvery()
+{
+  int every = tickRate / SPECTATERATE;
+  return every > 0 ? every : 1;
+}
+
+// Send spectators this tick if it's time, with the settings in keyframes
+int broadcastView()
+{
+  struct spectateGame game = gameForSpectators();
+  struct spectatePlayer sent = { frameCount, player.pos, normalisedMouse, player.kills, facing,
+                                 scheduledMovement.x != 0.f || scheduledMovement.y != 0.f, playerDead, shotgunCooldown <= 0.1f, 0 };
+  struct stateHeader header = { SPECTATEMAGIC, STATEVERSION, tickRate, worldSeed, activeRadius, horde.capacity };
+  return spectateBroadcastTick(&broadcast, &game, &sent, &header, sizeof(header));
+}
+
+// Start sending records to --broadcast
+int startBroadcast()
+{
+  if (!broadcastTarget)
+    return 0;
+  if (spectateBroadcastOpen(&broadcast, broadcastTarget, horde.capacity, spectateEvery()))
+  {
+    fprintf(stderr, "Could not broadcast to: %s\n", broadcastTarget);
+    return -1;
+  }
+  return 0;
+}
+
+// Connect to --spectate and take the game's settings from its keyframe,
+// then open the world for them
+int openSpectate(struct spectateClient *client)
+{
+  struct stateHeader raw, header;
+  if (spectateOpen(client, spectateSource, &raw, sizeof(raw)))
+    return -1;
+  struct snapReader r = { (const unsigned char *) &raw, sizeof(raw), 0, 0 };
+  if (readStateHeader(&r, &header, SPECTATEMAGIC))
+  {
+    fprintf(stderr, "Not a game to spectate: %s\n", spectateSource);
+    return -1;
+  }
+  stateSettings(&header);
+  if (setupHorde(zombieCapacity))
+    return -1;
+  jobsInit(threadCount);
+  return openWorld();
+}
+
+// Take the next record from --spectate into the game, returns its type
+int watchNext(struct spectateClient *client)
+{
+  struct spectateGame game = gameForSpectators();
+  struct spectatePlayer seen;
+  int type = spectateNext(client, &game, &seen);
+  if (type == SNAP_END)
+    return type;
+  frameCount = seen.frame;
+  prevPlayerPos = seen.jumped ? seen.pos : player.pos;
+  player.pos = seen.pos;
+  normalisedMouse = seen.aim;
+  player.kills = seen.kills;
+  facing = seen.facing;
+  scheduledMovement = (Vector2){ seen.moving, 0 };
+  playerDead = seen.dead;
+  shotgunCooldown = seen.ready ? 0.f : 1.f;
+  return type;
+}
+
+// Watch a --broadcast without a window, checking every record and
+// reporting what watching costs
+int runHeadlessSpectator()
+{
+  struct spectateClient client;
+  if (openSpectate(&client))
+    return 1;
+  unsigned int firstFrame = 0;
+  while (watchNext(&client) != SNAP_END)
+    if (client.records == 1)
+      firstFrame = frameCount;
+  if (client.broken)
+    fprintf(stderr, "Broken record after %d\n", client.records);
+  double seconds = (double)(frameCount - firstFrame) / tickRate;
+  printf("spectate: %d records, %zu bytes, %.2f KB a second over %.1f seconds of game\n",
+    client.records, client.in.received, seconds > 0 ? client.in.received / 1024.0 / seconds : 0, seconds);
+  printf("spectate: %d records didn't match the game, %d zombies in view at the end\n", client.mismatches, horde.count);
+  spectateClose(&client);
+  closeWorld();
+  jobsFree();
+  logFlush();
+  return client.mismatches ? 2 : 0;
+}
+
+#ifndef HEADLESS
+// Draw a game someone else is playing from --spectate. Records are taken
+// at the rate they were sent and frames drawn between them the way they are
+// between ticks. A spectator watching a socket waits with the game when it
+// is paused.
+int runSpectator()
+{
+  struct spectateClient client;
+  if (openSpectate(&client))
+    return 1;
+  watchNext(&client);
+  double interval = (double) spectateEvery() / tickRate;
+  double accumulator = 0;
+  int watching = 1;
+  while (!WindowShouldClose())
+  {
+    if (IsKeyPressed(KEY_F11)) fullscreenAdjust();
+    if (IsKeyPressed(KEY_F3)) showProfile = !showProfile;
+    accumulator += GetFrameTime();
+    if (accumulator > 0.25) accumulator = 0.25;
+    for (; watching && accumulator >= interval; accumulator -= interval)
+    {
+      int mismatches = client.mismatches;
+      if (watchNext(&client) == SNAP_END)
+      {
+        TraceLog(LOG_INFO, "SPECTATE: The game is over after %d records", client.records);
+        watching = 0;
+      }
+      else if (client.mismatches != mismatches)
+        TraceLog(LOG_WARNING, "SPECTATE: Record %d didn't match the game", client.records);
+    }
+    gamePaused = playerDead;
+    tickAlpha = watching ? accumulator / interval : 1.f;
+    viewPos = Vector2Lerp(prevPlayerPos, player.pos, tickAlpha);
+
+    BeginDrawing();
+      ClearBackground(RAYWHITE);
+      BeginMode2D(mainCam);
+        drawGame();
+      EndMode2D();
+      drawUI();
+      if (showProfile)
+        profileDraw(10, 190);
+    EndDrawing();
+    profileFrame();
+    logFlush();
   }
+  spectateClose(&client);
+  closeWorld();
+  jobsFree();
+  logFlush();
+  return 0;
+}
+#endif /* ifndef HEADLESS */
+
+int closeWorld()
+{
+  streamFree(&chunkStream);
+  regionClose(&regionStore);
+  cacheFree(&chunkCache);
+  free(activeChunks);
+  free(chunkBakes);
+  free(chunkShown);
+  free(chunkRanges);
   return 0;
 }
 
@@ -819,17 +2351,104 @@ float radianConvert(float angle)
     return angle;
 }
 
-char *getTile(Vector2 pos)
+// Get a tile of an active chunk and the chunk's slot, NULL if no active
+// chunk holds it
+char *activeTile(struct tileCoord tile, int *slot)
+{
+  int c = findActiveChunk(TILECHUNK(tile.x), TILECHUNK(tile.y));
+  if (slot) *slot = c;
+  if (c == -1) return NULL;
+  return &activeChunks[c]->tiles[TILELOCAL(tile.x)][TILELOCAL(tile.y)];
+}
+
+// Check whether any of the points is on a solid tile. Points outside the
+// active chunks count as open ground.
+int anySolid(const Vector2 points[], int count)
+{
+  // Points tend to share a chunk, only look it up again when that changes
+  int lastX = 0, lastY = 0;
+  const struct mapChunk *chunk = NULL;
+  int c = -1;
+  for (int i = 0; i < count; ++i)
+  {
+    struct tileCoord t = tileFromPos(points[i]);
+    if (c == -1 || TILECHUNK(t.x) != lastX || TILECHUNK(t.y) != lastY)
+    {
+      lastX = TILECHUNK(t.x);
+      lastY = TILECHUNK(t.y);
+      c = findActiveChunk(lastX, lastY);
+      if (c == -1) continue;
+      chunk = activeChunks[c];
+    }
+    if (chunk->tiles[TILELOCAL(t.x)][TILELOCAL(t.y)])
+      return 1;
+  }
+  return 0;
+}
+
+// Change a tile and have it redrawn in the chunk's baked ground and the
+// paths found around it again
+int setTile(Vector2 pos, char value)
+{
+  struct tileCoord t = tileFromPos(pos);
+  int c;
+  char *tile = activeTile(t, &c);
+  if (!tile) return -1;
+  if (!activeChunks[c]->edited)
+    editedHash ^= chunkTilesHash(activeChunks[c]);
+  editedHash ^= tileHash(t.x, t.y, *tile) ^ tileHash(t.x, t.y, value);
+  *tile = value;
+  // It can't be generated again now
+  activeChunks[c]->edited = 1;
+  if (broadcastTarget)
+    spectateNoteTile(&broadcast, t);
+  struct chunkBake *bake = bakeFind(activeChunks[c]->pos.x, activeChunks[c]->pos.y);
+  int x = TILELOCAL(t.x), y = TILELOCAL(t.y);
+  if (bake)
+    bakeMarkDirty(bake, x, y, x + 1, y + 1);
+  flowSetTile(&flow, t, value);
+  return 0;
+}
+
+// The middle of the spawn point closest to pos out of the ones in its chunk
+Vector2 nearestSpawnPoint(Vector2 pos)
+{
+  struct tileCoord t = tileFromPos(pos);
+  struct tileCoord spawns[GENSPAWNS];
+  genSpawnPoints(worldSeed, TILECHUNK(t.x), TILECHUNK(t.y), spawns);
+  Vector2 best = pos;
+  float bestDistance = -1;
+  for (int s = 0; s < GENSPAWNS; ++s)
+  {
+    Vector2 spawn = { spawns[s].x + 0.5f, spawns[s].y + 0.5f };
+    float distance = Vector2Distance(spawn, pos);
+    if (bestDistance < 0 || distance < bestDistance)
+    {
+      best = spawn;
+      bestDistance = distance;
+    }
+  }
+  return best;
+}
+
+// Find the tiles of a chunk that land on screen when it is centred on centre,
+// as x and y ranges { x0, x1, y0, y1 } (end exclusive). Returns 0 if no tile
+// of the chunk is visible.
+int chunkVisibleRange(const struct mapChunk *chunk, Vector2 centre, float tileSize, int range[4])
 {
-  int px = pos.x > 0 ? (int) pos.x : (int) pos.x - 1;
-  int py = pos.y > 0 ? (int) pos.y : (int) pos.y - 1;
-  py++;
-  if (px < 10) px++;
-  int pCx = px > 0 ? (int) px / 128 : (int) px / 128 - 1;
-  int pCy = py > 0 ? (int) py / 128 : (int) py-- / 128 - 1;
-  int chunkTileX = (int)(pos.x - CHUNKSIZE * pCx);
-  int chunkTileY = (int)(pos.y - CHUNKSIZE * pCy);
-  return &activeChunks[findChunk(4, activeChunks, pCx, pCy, 0)].tiles[chunkTileX][chunkTileY];
+  // Same bounds drawGame tests each tile against, plus a tile of slack
+  float halfW = sW / tileSize, halfH = sH / tileSize;
+  int originX = CHUNKSIZE * (int) chunk->pos.x;
+  int originY = CHUNKSIZE * (int) chunk->pos.y;
+  int x0 = (int) floorf(centre.x - 0.55f * halfW) - 1 - originX;
+  int x1 = (int) ceilf(centre.x + 0.5f * halfW) + 1 - originX;
+  int y0 = (int) floorf(centre.y - 0.55f * halfH) - 1 - originY;
+  int y1 = (int) ceilf(centre.y + 0.5f * halfH) + 1 - originY;
+  range[0] = x0 < 0 ? 0 : x0;
+  range[1] = x1 > CHUNKSIZE ? CHUNKSIZE : x1;
+  range[2] = y0 < 0 ? 0 : y0;
+  range[3] = y1 > CHUNKSIZE ? CHUNKSIZE : y1;
+  return range[0] < range[1] && range[2] < range[3];
 }
 
 /* Not implemented (TODO)
@@ -840,6 +2459,7 @@ int spiralFindTile(Vector2 pos, int *x, int *y, int *activeChunk, char match)
 }
 */
 
+#ifndef HEADLESS
 int startScreen()
 {
   frameCount++;
@@ -862,15 +2482,17 @@ int startScreen()
   controls[2] = "p - pause / start game";
   controls[3] = "space - fire";
   controls[4] = "esc - quit";
-  Texture2D zombieTex = zombieLeftWalk[(frameCount % (FPS / 4)) * 8 / FPS];
-  Texture2D playerTex = manLeftWalk[((frameCount + 69) % (FPS / 5)) * 10 / FPS];
+  // Nothing is ticking here so animate by time
+  double now = GetTime();
+  int zombieSprite = SPRITE_ZOMBIELEFTWALK1 + (int)(now * 8) % 2;
+  int playerSprite = SPRITE_MANLEFTWALK1 + (int)(now * 10 + 0.5) % 2;
   float tileSize = sH / (float) TILESONSCREEN;
   BeginDrawing();
   ClearBackground((Color){ 0, 132, 45, 255 });
   DrawText("Hoard Avoidance", (sW - MeasureText("Hoard Avoidance", tileSize * 4)) / 2, tileSize, tileSize * 4, GREEN);
-  DrawTextureEx(zombieTex, (Vector2){ sW * 0.35, sH * 0.325 }, 0.f, tileSize / 4.f, WHITE);
-  DrawTextureEx(zombieTex, (Vector2){ sW * 0.3, sH * 0.275 }, 0.f, tileSize / 4.f, WHITE);
-  DrawTextureEx(playerTex, (Vector2){ sW * 0.6, sH * 0.3 }, 0.f, tileSize / 4.f, WHITE);
+  atlasDraw(&sprites, zombieSprite, (Vector2){ sW * 0.35, sH * 0.325 }, tileSize / 4.f);
+  atlasDraw(&sprites, zombieSprite, (Vector2){ sW * 0.3, sH * 0.275 }, tileSize / 4.f);
+  atlasDraw(&sprites, playerSprite, (Vector2){ sW * 0.6, sH * 0.3 }, tileSize / 4.f);
   for (int i = 0; i < 5; ++i)
     DrawText(controls[i], (sW - MeasureText(controls[i], tileSize / 2)) / 2, sH / 2.f + i * tileSize, tileSize / 2, GREEN);
   const char *mouseModeText = "Mouse";
@@ -882,3 +2504,4 @@ int startScreen()
   EndDrawing();
   return 0;
 }
+#endif /* ifndef HEADLESS */
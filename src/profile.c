@@ -0,0 +1,132 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "profile.h"
+#ifndef HEADLESS
+#include <raylib.h>
+#endif /* ifndef HEADLESS */
+
+// Most section timings kept for a trace, about a minute of frames
+#define TRACEMAX (1 << 20)
+
+const char *profileNames[PROFILESECTIONS] = {
+  [PROFILE_INPUT] = "input",
+  [PROFILE_ZOMBIES] = "zombies",
+  [PROFILE_SEPARATION] = "separation",
+  [PROFILE_COLLISION] = "collision",
+  [PROFILE_CHUNKS] = "chunks",
+  [PROFILE_TILES] = "tiles",
+  [PROFILE_SPRITES] = "sprites",
+  [PROFILE_UI] = "ui",
+};
+
+struct traceEvent
+{
+  int section;
+  double start, end;
+};
+
+static struct profileSection sections[PROFILESECTIONS];
+static int historyNext;
+static struct traceEvent *trace;
+static int traceCount;
+static double traceStart;
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int profileBegin(int section)
+{
+  sections[section].start = now();
+  return 0;
+}
+
+int profileEnd(int section)
+{
+  double end = now();
+  struct profileSection *s = &sections[section];
+  s->frame += end - s->start;
+  if (trace && traceCount < TRACEMAX)
+    trace[traceCount++] = (struct traceEvent){ section, s->start, end };
+  return 0;
+}
+
+int profileFrame()
+{
+  for (int i = 0; i < PROFILESECTIONS; ++i)
+  {
+    sections[i].history[historyNext] = sections[i].frame * 1000;
+    sections[i].total += sections[i].frame;
+    sections[i].frame = 0;
+  }
+  historyNext = (historyNext + 1) % PROFILEHISTORY;
+  return 0;
+}
+
+float profileAverage(int section)
+{
+  float total = 0;
+  for (int i = 0; i < PROFILEHISTORY; ++i)
+    total += sections[section].history[i];
+  return total / PROFILEHISTORY;
+}
+
+double profileTotal(int section)
+{
+  return sections[section].total;
+}
+
+int profileTraceStart()
+{
+  if (!trace)
+    trace = malloc(sizeof(struct traceEvent) * TRACEMAX);
+  traceCount = 0;
+  traceStart = now();
+  return trace ? 0 : -1;
+}
+
+int profileTraceWrite(const char *path)
+{
+  FILE *f = fopen(path, "w");
+  if (!f)
+    return -1;
+  fprintf(f, "{\"traceEvents\":[\n");
+  for (int i = 0; i < traceCount; ++i)
+    // Complete events, times in microseconds from when tracing started
+    fprintf(f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}\n",
+      i ? "," : "", profileNames[trace[i].section],
+      (trace[i].start - traceStart) * 1e6, (trace[i].end - trace[i].start) * 1e6);
+  fprintf(f, "],\"displayTimeUnit\":\"ms\"}\n");
+  return fclose(f) ? -1 : 0;
+}
+
+#ifndef HEADLESS
+int profileDraw(int x, int y)
+{
+  // Each graph's top is this many milliseconds, a 60 fps frame
+  const float scale = 16.7f;
+  const int rowHeight = 40, labelWidth = 170;
+  Color colours[PROFILESECTIONS] = { SKYBLUE, RED, ORANGE, PURPLE, BROWN, DARKGREEN, GOLD, MAGENTA };
+  DrawRectangle(x, y, labelWidth + PROFILEHISTORY + 10, PROFILESECTIONS * rowHeight + 10, (Color){ 0, 0, 0, 160 });
+  for (int s = 0; s < PROFILESECTIONS; ++s)
+  {
+    int top = y + 5 + s * rowHeight, bottom = top + rowHeight - 4;
+    DrawText(TextFormat("%s %.2f ms", profileNames[s], profileAverage(s)), x + 5, top + 10, 16, RAYWHITE);
+    // Oldest frame on the left
+    for (int i = 0; i < PROFILEHISTORY; ++i)
+    {
+      float ms = sections[s].history[(historyNext + i) % PROFILEHISTORY];
+      int h = ms / scale * (rowHeight - 4);
+      if (h > rowHeight - 4) h = rowHeight - 4;
+      if (h > 0) DrawLine(x + labelWidth + i, bottom, x + labelWidth + i, bottom - h, colours[s]);
+    }
+    DrawLine(x + labelWidth, bottom, x + labelWidth + PROFILEHISTORY, bottom, GRAY);
+  }
+  return 0;
+}
+#endif /* ifndef HEADLESS */
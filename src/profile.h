@@ -0,0 +1,50 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Frames kept for the overlay's graphs
+#define PROFILEHISTORY 240
+
+// The parts of a frame that are timed
+enum
+{
+  PROFILE_INPUT,
+  PROFILE_ZOMBIES,
+  PROFILE_SEPARATION,
+  PROFILE_COLLISION,
+  PROFILE_CHUNKS,
+  PROFILE_TILES,
+  PROFILE_SPRITES,
+  PROFILE_UI,
+  PROFILESECTIONS
+};
+
+// Time spent in each section, summed over a frame (a frame can run several
+// ticks or none). Sections are timed on the main thread only, and aren't
+// nested: end one before beginning the next.
+struct profileSection
+{
+  double start;
+  double frame; // Seconds so far this frame
+  double total; // Seconds over every finished frame
+  float history[PROFILEHISTORY]; // Milliseconds in each of the last frames
+};
+
+extern const char *profileNames[PROFILESECTIONS];
+
+int profileBegin(int section);
+int profileEnd(int section);
+// Close the frame, moving every section's time into its history
+int profileFrame();
+// Average milliseconds per frame of a section over the history
+float profileAverage(int section);
+// Seconds spent in a section over every finished frame
+double profileTotal(int section);
+// Keep every section's start and end from now on for profileTraceWrite
+int profileTraceStart();
+// Write the kept sections as Chrome trace_event JSON (chrome://tracing or
+// ui.perfetto.dev open it)
+int profileTraceWrite(const char *path);
+// Draw a graph of each section's last frames, with the top left at (x, y)
+int profileDraw(int x, int y);
+
+#endif /* PROFILE_H */
@@ -0,0 +1,292 @@
+#define _POSIX_C_SOURCE 200809L
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "region.h"
+
+#define REGIONVERSION 2
+// Packed chunks start on a cache line, mostly empty ones are only a few bytes
+#define DATAALIGN 64
+// Files grow a megabyte at a time so they aren't remapped on every save
+#define GROWBYTES (1 << 20)
+
+static size_t alignUp(size_t n, size_t to)
+{
+  return (n + to - 1) / to * to;
+}
+
+static int floorDiv(int a, int b)
+{
+  return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static int regionPath(const struct regionStore *store, int rx, int ry, char *path, size_t size)
+{
+  return snprintf(path, size, "%s/r.%d.%d.hoard", store->dir, rx, ry);
+}
+
+static int unmapRegion(struct region *r)
+{
+  if (r->base) munmap(r->base, r->size);
+  if (r->fd != -1) close(r->fd);
+  r->base = NULL;
+  r->fd = -1;
+  r->size = 0;
+  r->dirty = 0;
+  return 0;
+}
+
+static int mapRegion(struct region *r, size_t size)
+{
+  if (r->base) munmap(r->base, r->size);
+  r->base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, 0);
+  if (r->base == MAP_FAILED)
+  {
+    r->base = NULL;
+    return -1;
+  }
+  r->size = size;
+  return 0;
+}
+
+// Make sure the file and its mapping are at least size bytes
+static int growRegion(struct region *r, size_t size)
+{
+  if (size <= r->size) return 0;
+  size = alignUp(size, GROWBYTES);
+  if (ftruncate(r->fd, size)) return -1;
+  return mapRegion(r, size);
+}
+
+// Find an open region or open its file. Without create a missing file gives NULL.
+static struct region *getRegion(struct regionStore *store, int rx, int ry, int create)
+{
+  struct region *slot = NULL;
+  for (int i = 0; i < MAXOPENREGIONS; ++i)
+  {
+    struct region *r = &store->open[i];
+    if (r->base && r->x == rx && r->y == ry)
+    {
+      r->lastUsed = ++store->useCount;
+      return r;
+    }
+    // Use an empty slot, otherwise the one used longest ago
+    if (!slot || (slot->base && (!r->base || r->lastUsed < slot->lastUsed)))
+      slot = r;
+  }
+
+  char path[512];
+  regionPath(store, rx, ry, path, sizeof(path));
+  int fd = open(path, O_RDWR | (create ? O_CREAT : 0), 0644);
+  if (fd == -1) return NULL;
+  struct stat st;
+  if (fstat(fd, &st))
+  {
+    close(fd);
+    return NULL;
+  }
+
+  // Pages written through the old mapping stay in the page cache after it goes
+  unmapRegion(slot);
+  slot->fd = fd;
+  slot->x = rx;
+  slot->y = ry;
+  slot->lastUsed = ++store->useCount;
+  if ((size_t) st.st_size < sizeof(struct regionHeader))
+  {
+    // New (or cut short) file, start it with an empty index
+    if (growRegion(slot, alignUp(sizeof(struct regionHeader), 4096)))
+    {
+      unmapRegion(slot);
+      return NULL;
+    }
+    struct regionHeader *header = (struct regionHeader *) slot->base;
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, "HRGN", 4);
+    header->version = REGIONVERSION;
+    header->regionSize = REGIONSIZE;
+    header->chunkSize = CHUNKSIZE;
+    header->dataEnd = alignUp(sizeof(struct regionHeader), 4096);
+    slot->dirty = 1;
+    return slot;
+  }
+  if (mapRegion(slot, st.st_size))
+  {
+    unmapRegion(slot);
+    return NULL;
+  }
+  struct regionHeader *header = (struct regionHeader *) slot->base;
+  if (memcmp(header->magic, "HRGN", 4) || header->version != REGIONVERSION ||
+      header->regionSize != REGIONSIZE || header->chunkSize != CHUNKSIZE || header->dataEnd > slot->size)
+  {
+    fprintf(stderr, "Ignoring region file from another version: %s\n", path);
+    unmapRegion(slot);
+    return NULL;
+  }
+  return slot;
+}
+
+// Push part of a region to disk, rounded out to whole pages as msync wants
+static int syncRange(struct region *r, size_t offset, size_t length, int flags)
+{
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t start = offset / page * page;
+  size_t end = alignUp(offset + length, page);
+  if (end > r->size) end = r->size;
+  return msync(r->base + start, end - start, flags);
+}
+
+int regionOpen(struct regionStore *store, const char *dir, int flushPolicy)
+{
+  memset(store, 0, sizeof(*store));
+  for (int i = 0; i < MAXOPENREGIONS; ++i)
+    store->open[i].fd = -1;
+  store->flushPolicy = flushPolicy;
+  // A directory of this run's own either way, so resetting it never takes
+  // files it didn't make
+  if (dir && mkdir(dir, 0755) && errno != EEXIST)
+    return -1;
+  const char *tmp = getenv("TMPDIR");
+  const char *parent = dir ? dir : tmp ? tmp : "/tmp";
+  if (snprintf(store->dir, sizeof(store->dir), "%s/hoard-XXXXXX", parent) >= (int) sizeof(store->dir))
+    return -1;
+  if (!mkdtemp(store->dir))
+    return -1;
+  store->ownsDir = !dir;
+  return 0;
+}
+
+int regionClose(struct regionStore *store)
+{
+  if (store->ownsDir)
+  {
+    regionReset(store);
+    rmdir(store->dir);
+    return 0;
+  }
+  if (store->flushPolicy != REGIONFLUSH_NEVER)
+    regionFlush(store, 1);
+  for (int i = 0; i < MAXOPENREGIONS; ++i)
+    unmapRegion(&store->open[i]);
+  return 0;
+}
+
+int regionReset(struct regionStore *store)
+{
+  for (int i = 0; i < MAXOPENREGIONS; ++i)
+    unmapRegion(&store->open[i]);
+  DIR *d = opendir(store->dir);
+  if (!d) return -1;
+  struct dirent *entry;
+  char path[512];
+  while ((entry = readdir(d)))
+  {
+    int rx, ry;
+    char end;
+    // Only touch files that look like ours
+    if (sscanf(entry->d_name, "r.%d.%d.hoar%c", &rx, &ry, &end) != 3 || end != 'd')
+      continue;
+    regionPath(store, rx, ry, path, sizeof(path));
+    unlink(path);
+  }
+  closedir(d);
+  store->saved = store->loaded = 0;
+  return 0;
+}
+
+int regionSave(struct regionStore *store, int x, int y, const unsigned char *data, int length)
+{
+  int rx = floorDiv(x, REGIONSIZE), ry = floorDiv(y, REGIONSIZE);
+  struct region *r = getRegion(store, rx, ry, 1);
+  if (!r) return -1;
+  int i = (y - ry * REGIONSIZE) * REGIONSIZE + (x - rx * REGIONSIZE);
+
+  struct regionHeader *header = (struct regionHeader *) r->base;
+  uint32_t offset = header->index[i].offset;
+  // Reuse the chunk's old space if it fits, otherwise add it to the end
+  if (!header->index[i].length || alignUp(header->index[i].length, DATAALIGN) < (size_t) length)
+  {
+    offset = header->dataEnd;
+    if (growRegion(r, offset + alignUp(length, DATAALIGN)))
+      return -1;
+    header = (struct regionHeader *) r->base;
+    header->dataEnd = offset + alignUp(length, DATAALIGN);
+  }
+  memcpy(r->base + offset, data, length);
+  header->index[i].offset = offset;
+  header->index[i].length = length;
+  r->dirty = 1;
+  store->saved++;
+
+  if (store->flushPolicy != REGIONFLUSH_NEVER)
+  {
+    int flags = store->flushPolicy == REGIONFLUSH_SYNC ? MS_SYNC : MS_ASYNC;
+    syncRange(r, offset, length, flags);
+    syncRange(r, 0, sizeof(struct regionHeader), flags);
+    if (store->flushPolicy == REGIONFLUSH_SYNC)
+      fsync(r->fd);
+  }
+  return 0;
+}
+
+int regionLoad(struct regionStore *store, int x, int y, unsigned char *out, int capacity)
+{
+  int rx = floorDiv(x, REGIONSIZE), ry = floorDiv(y, REGIONSIZE);
+  struct region *r = getRegion(store, rx, ry, 0);
+  if (!r) return -1;
+  int i = (y - ry * REGIONSIZE) * REGIONSIZE + (x - rx * REGIONSIZE);
+  const struct regionHeader *header = (const struct regionHeader *) r->base;
+  uint32_t offset = header->index[i].offset, length = header->index[i].length;
+  if (!length || length > (uint32_t) capacity || offset + length > r->size)
+    return -1;
+  memcpy(out, r->base + offset, length);
+  store->loaded++;
+  return length;
+}
+
+int regionEach(struct regionStore *store, int (*fn)(int x, int y, const unsigned char *data, int length, void *user), void *user)
+{
+  DIR *d = opendir(store->dir);
+  if (!d) return -1;
+  struct dirent *entry;
+  while ((entry = readdir(d)))
+  {
+    int rx, ry;
+    char end;
+    if (sscanf(entry->d_name, "r.%d.%d.hoar%c", &rx, &ry, &end) != 3 || end != 'd')
+      continue;
+    struct region *r = getRegion(store, rx, ry, 0);
+    if (!r) continue;
+    const struct regionHeader *header = (const struct regionHeader *) r->base;
+    for (int i = 0; i < REGIONSIZE * REGIONSIZE; ++i)
+    {
+      uint32_t offset = header->index[i].offset, length = header->index[i].length;
+      if (length && offset + length <= r->size)
+        fn(rx * REGIONSIZE + i % REGIONSIZE, ry * REGIONSIZE + i / REGIONSIZE, r->base + offset, length, user);
+    }
+  }
+  closedir(d);
+  return 0;
+}
+
+int regionFlush(struct regionStore *store, int wait)
+{
+  for (int i = 0; i < MAXOPENREGIONS; ++i)
+  {
+    struct region *r = &store->open[i];
+    if (!r->base || !r->dirty) continue;
+    msync(r->base, r->size, wait ? MS_SYNC : MS_ASYNC);
+    if (wait)
+    {
+      fsync(r->fd);
+      r->dirty = 0;
+    }
+  }
+  return 0;
+}
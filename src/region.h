@@ -0,0 +1,73 @@
+#ifndef REGION_H
+#define REGION_H
+
+#include <stdint.h>
+#include "world.h"
+
+// Chunks per side of a region file
+#define REGIONSIZE 16
+// Region files kept mapped at once
+#define MAXOPENREGIONS 8
+
+enum {REGIONFLUSH_NEVER, REGIONFLUSH_ASYNC, REGIONFLUSH_SYNC}; // When saved chunks are pushed to disk
+
+// Start of every region file, followed by the packed chunks. Offsets are
+// from the start of the file, a length of 0 means the chunk was never saved.
+// A chunk that packs bigger than before moves to the end of the file.
+struct regionHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t regionSize;
+  uint32_t chunkSize;
+  uint32_t dataEnd;
+  uint32_t reserved[3];
+  struct
+  {
+    uint32_t offset;
+    uint32_t length;
+  } index[REGIONSIZE * REGIONSIZE];
+};
+
+struct region
+{
+  int x, y;
+  int fd;
+  unsigned char *base; // The whole file, mapped
+  size_t size;
+  unsigned int lastUsed;
+  int dirty;
+};
+
+// Chunks that fell out of the chunk cache, grouped into memory mapped
+// region files so loading one back is a copy out of the page cache
+struct regionStore
+{
+  char dir[256];
+  int flushPolicy;
+  int ownsDir; // Made a temporary directory that should go when closed
+  struct region open[MAXOPENREGIONS];
+  unsigned int useCount;
+  int saved;
+  int loaded;
+};
+
+// Put the region files in a new directory in dir, which is kept, or in a
+// temporary directory if dir is NULL
+int regionOpen(struct regionStore *store, const char *dir, int flushPolicy);
+// Unmap everything, and remove the directory if it was temporary
+int regionClose(struct regionStore *store);
+// Delete every region file in the store's own directory, for starting a
+// new game
+int regionReset(struct regionStore *store);
+// Store a packed chunk (see chunkPack)
+int regionSave(struct regionStore *store, int x, int y, const unsigned char *data, int length);
+// Copy out a packed chunk if it was saved before, returns its length or -1
+// if it wasn't
+int regionLoad(struct regionStore *store, int x, int y, unsigned char *out, int capacity);
+// Call fn with every chunk saved so far, packed
+int regionEach(struct regionStore *store, int (*fn)(int x, int y, const unsigned char *data, int length, void *user), void *user);
+// Push every dirty region to disk
+int regionFlush(struct regionStore *store, int wait);
+
+#endif /* REGION_H */
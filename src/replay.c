@@ -0,0 +1,143 @@
+#include <string.h>
+#include "replay.h"
+
+#define REPLAYMAGIC "HRPL"
+#define REPLAYVERSION 4
+// Flags above the keys in each record's first byte
+#define RECORDSTATE 0x20 // A save-state was loaded, its length and bytes follow
+#define RECORDAIM 0x40   // The mouse mode and aim follow
+#define RECORDRESET 0x80 // A new game, nothing else in the record
+
+int replayCreate(struct replay *r, const char *path, struct replayHeader *header)
+{
+  memcpy(header->magic, REPLAYMAGIC, 4);
+  header->version = REPLAYVERSION;
+  r->file = fopen(path, "wb");
+  if (!r->file)
+    return -1;
+  r->writing = 1;
+  r->ticks = 0;
+  r->stateLength = 0;
+  // Nothing matches this, so the first tick always writes its aim
+  r->last = (struct tickInput){ 0xFF, 0xFF, { 0, 0 } };
+  if (fwrite(header, sizeof(*header), 1, r->file) != 1)
+  {
+    replayClose(r);
+    return -1;
+  }
+  return 0;
+}
+
+int replayOpen(struct replay *r, const char *path, struct replayHeader *header)
+{
+  r->file = fopen(path, "rb");
+  if (!r->file)
+    return -1;
+  r->writing = 0;
+  r->ticks = 0;
+  r->stateLength = 0;
+  r->last = (struct tickInput){ 0, 0, { 0, 0 } };
+  if (fread(header, sizeof(*header), 1, r->file) != 1 ||
+      memcmp(header->magic, REPLAYMAGIC, 4) || header->version != REPLAYVERSION)
+  {
+    replayClose(r);
+    return -1;
+  }
+  return 0;
+}
+
+int replayClose(struct replay *r)
+{
+  if (!r->file)
+    return 0;
+  int err = fclose(r->file);
+  r->file = NULL;
+  return err ? -1 : 0;
+}
+
+int replayWriteTick(struct replay *r, const struct tickInput *in, uint32_t checksum)
+{
+  unsigned char flags = in->keys & 31;
+  int aimChanged = in->mouseMode != r->last.mouseMode || in->aim.x != r->last.aim.x || in->aim.y != r->last.aim.y;
+  if (aimChanged)
+    flags |= RECORDAIM;
+  fputc(flags, r->file);
+  if (aimChanged)
+  {
+    fputc(in->mouseMode, r->file);
+    fwrite(&in->aim, sizeof(in->aim), 1, r->file);
+  }
+  fwrite(&checksum, sizeof(checksum), 1, r->file);
+  r->last = *in;
+  r->ticks++;
+  return ferror(r->file) ? -1 : 0;
+}
+
+int replayWriteReset(struct replay *r)
+{
+  fputc(RECORDRESET, r->file);
+  return ferror(r->file) ? -1 : 0;
+}
+
+int replayWriteState(struct replay *r, const struct snapWriter *state)
+{
+  uint32_t length = state->length;
+  fputc(RECORDSTATE, r->file);
+  fwrite(&length, sizeof(length), 1, r->file);
+  fwrite(state->data, 1, state->length, r->file);
+  return ferror(r->file) ? -1 : 0;
+}
+
+int replayRead(struct replay *r, struct tickInput *in, uint32_t *checksum)
+{
+  if (r->stateLength && fseek(r->file, r->stateLength, SEEK_CUR))
+    return REPLAY_END;
+  r->stateLength = 0;
+  int flags = fgetc(r->file);
+  if (flags == EOF)
+    return REPLAY_END;
+  if (flags & RECORDRESET)
+    return REPLAY_RESET;
+  if (flags & RECORDSTATE)
+    return fread(&r->stateLength, sizeof(r->stateLength), 1, r->file) == 1 ? REPLAY_STATE : REPLAY_END;
+  if (flags & RECORDAIM)
+  {
+    int mode = fgetc(r->file);
+    if (mode == EOF || fread(&r->last.aim, sizeof(r->last.aim), 1, r->file) != 1)
+      return REPLAY_END;
+    r->last.mouseMode = mode;
+  }
+  if (fread(checksum, sizeof(*checksum), 1, r->file) != 1)
+    return REPLAY_END;
+  r->last.keys = flags & 31;
+  *in = r->last;
+  r->ticks++;
+  return REPLAY_TICK;
+}
+
+int replayReadState(struct replay *r, struct snapWriter *state)
+{
+  state->length = 0;
+  unsigned char buffer[65536];
+  while (r->stateLength)
+  {
+    size_t want = r->stateLength < sizeof(buffer) ? r->stateLength : sizeof(buffer);
+    if (fread(buffer, 1, want, r->file) != want || snapPut(state, buffer, want))
+      return -1;
+    r->stateLength -= want;
+  }
+  return 0;
+}
+
+uint32_t replayHash(uint32_t hash, const void *data, size_t length)
+{
+  // FNV-1a a word at a time, fast enough to run over the whole horde every tick
+  const unsigned char *bytes = data;
+  for (size_t i = 0; i + 4 <= length; i += 4)
+  {
+    uint32_t word;
+    memcpy(&word, bytes + i, 4);
+    hash = (hash ^ word) * 16777619u;
+  }
+  return hash;
+}
@@ -0,0 +1,63 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <raylib.h>
+#include "snapshot.h"
+
+enum {INPUT_UP = 1, INPUT_DOWN = 2, INPUT_LEFT = 4, INPUT_RIGHT = 8, INPUT_FIRE = 16}; // Input flags
+enum {REPLAY_END, REPLAY_TICK, REPLAY_RESET, REPLAY_STATE}; // What replayRead found
+
+// Everything the simulation reads from the player in one tick
+struct tickInput
+{
+  unsigned char keys; // INPUT_* flags held down
+  unsigned char mouseMode;
+  Vector2 aim; // Mouse position relative to the centre of the screen
+};
+
+// Start of a replay file, the settings that change how a game plays out
+struct replayHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t tickRate;
+  uint32_t seed;
+  uint32_t viewRadius; // Chunks the active window reaches out
+  uint32_t zombieCapacity;
+  uint32_t zombies; // Spawned around the player before the first tick
+};
+
+// A recording of every tick's input and a checksum of the state after it.
+// Each tick is a byte of keys, the mouse mode and aim only when they
+// changed, then the checksum, so most ticks take 5 bytes.
+struct replay
+{
+  FILE *file;
+  int writing;
+  int ticks; // Read or written so far
+  struct tickInput last;
+  uint32_t stateLength; // Bytes of the last save-state read that haven't been
+};
+
+// Start a recording, header holds the settings (magic and version are filled in)
+int replayCreate(struct replay *r, const char *path, struct replayHeader *header);
+// Open a recording to play back, and read its settings into header
+int replayOpen(struct replay *r, const char *path, struct replayHeader *header);
+int replayClose(struct replay *r);
+int replayWriteTick(struct replay *r, const struct tickInput *in, uint32_t checksum);
+// Mark that a new game was started
+int replayWriteReset(struct replay *r);
+// Mark that a save-state was loaded, state is the whole of it
+int replayWriteState(struct replay *r, const struct snapWriter *state);
+// Read the next record, filling in and checksum for a tick. Returns
+// REPLAY_END at the end of the file (or a cut off record).
+int replayRead(struct replay *r, struct tickInput *in, uint32_t *checksum);
+// Read in the save-state after replayRead returned REPLAY_STATE, one that
+// isn't read is skipped
+int replayReadState(struct replay *r, struct snapWriter *state);
+// Add length bytes of data to a running checksum, length a multiple of 4
+uint32_t replayHash(uint32_t hash, const void *data, size_t length);
+
+#endif /* REPLAY_H */
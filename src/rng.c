@@ -0,0 +1,53 @@
+#include "rng.h"
+
+// splitmix64's finaliser, every input bit affects every output bit
+static unsigned long long mix(unsigned long long x)
+{
+  x ^= x >> 30;
+  x *= 0xBF58476D1CE4E5B9ull;
+  x ^= x >> 27;
+  x *= 0x94D049BB133111EBull;
+  x ^= x >> 31;
+  return x;
+}
+
+static unsigned long long streamKey(unsigned int seed, int stream)
+{
+  return mix(seed ^ mix((unsigned long long)(unsigned int) stream + 0x9E3779B97F4A7C15ull));
+}
+
+int rngSeed(struct rng *r, unsigned int seed, int stream)
+{
+  r->key = streamKey(seed, stream);
+  r->counter = 0;
+  return 0;
+}
+
+unsigned int rngNext(struct rng *r)
+{
+  return mix(r->key + r->counter++ * 0x9E3779B97F4A7C15ull) >> 32;
+}
+
+int rngRange(struct rng *r, int min, int max)
+{
+  if (min > max)
+  {
+    int tmp = max;
+    max = min;
+    min = tmp;
+  }
+  // Scale instead of taking a remainder, the bias is at most span / 2^32
+  unsigned long long span = (unsigned long long)((long long) max - min + 1);
+  return min + (int)((rngNext(r) * span) >> 32);
+}
+
+float rngFloat(struct rng *r)
+{
+  return (rngNext(r) >> 8) * (1.f / 16777216.f);
+}
+
+unsigned int rngHash(unsigned int seed, int stream, int a, int b)
+{
+  unsigned long long ab = (unsigned long long)(unsigned int) a << 32 | (unsigned int) b;
+  return mix(streamKey(seed, stream) ^ mix(ab)) >> 32;
+}
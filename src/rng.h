@@ -0,0 +1,39 @@
+#ifndef RNG_H
+#define RNG_H
+
+// Random numbers worked out from a seed, a stream and a counter, with no
+// hidden state. The same seed always gives the same game, and each stream
+// is independent, so one system drawing more numbers doesn't change what
+// any other gets. Parallel code should hash by entity or tile, never by
+// thread, so the thread count doesn't matter.
+
+// Streams drawn from one world seed
+enum
+{
+  RNGSTREAM_TILES,       // Shade of each tile
+  RNGSTREAM_SPAWN,       // Where and when zombies appear
+  RNGSTREAM_SCENARIO,    // Headless scenario input
+  RNGSTREAM_WALLS,       // Where the generator puts walls
+  RNGSTREAM_CLEARINGS,   // Where it leaves none
+  RNGSTREAM_SPAWNPOINTS, // Where in each chunk zombies come out
+  RNGSTREAMS
+};
+
+// A sequence of numbers from one stream
+struct rng
+{
+  unsigned long long key;
+  unsigned long long counter;
+};
+
+// Start stream of seed from the beginning
+int rngSeed(struct rng *r, unsigned int seed, int stream);
+unsigned int rngNext(struct rng *r);
+// From min to max, both included
+int rngRange(struct rng *r, int min, int max);
+// From 0 up to (not including) 1
+float rngFloat(struct rng *r);
+// A number for (a, b) in stream of seed, e.g. a tile's world coordinates
+unsigned int rngHash(unsigned int seed, int stream, int a, int b);
+
+#endif /* RNG_H */
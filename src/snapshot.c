@@ -0,0 +1,333 @@
+#define _POSIX_C_SOURCE 200809L
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "log.h"
+#include "snapshot.h"
+
+// Longest a spectator can hold up a send before being dropped, in ms
+#define SENDTIMEOUT 100
+// Targets starting with this are Unix sockets
+#define SOCKETPREFIX "unix:"
+
+int snapFree(struct snapWriter *w)
+{
+  free(w->data);
+  memset(w, 0, sizeof(*w));
+  return 0;
+}
+
+int snapPut(struct snapWriter *w, const void *data, size_t length)
+{
+  if (w->failed)
+    return -1;
+  if (w->length + length > w->capacity)
+  {
+    size_t capacity = w->capacity ? w->capacity : 4096;
+    while (capacity < w->length + length)
+      capacity *= 2;
+    unsigned char *grown = realloc(w->data, capacity);
+    if (!grown)
+    {
+      w->failed = 1;
+      return -1;
+    }
+    w->data = grown;
+    w->capacity = capacity;
+  }
+  memcpy(w->data + w->length, data, length);
+  w->length += length;
+  return 0;
+}
+
+int snapPutU32(struct snapWriter *w, uint32_t v)
+{
+  return snapPut(w, &v, sizeof(v));
+}
+
+int snapPutFloat(struct snapWriter *w, float v)
+{
+  return snapPut(w, &v, sizeof(v));
+}
+
+int snapPutVarint(struct snapWriter *w, uint32_t v)
+{
+  unsigned char bytes[5];
+  int n = 0;
+  for (; v >= 0x80; v >>= 7)
+    bytes[n++] = (v & 0x7F) | 0x80;
+  bytes[n++] = v;
+  return snapPut(w, bytes, n);
+}
+
+int snapPutSigned(struct snapWriter *w, int32_t v)
+{
+  // Zigzag: 0, -1, 1, -2... become 0, 1, 2, 3...
+  return snapPutVarint(w, ((uint32_t) v << 1) ^ (uint32_t)(v >> 31));
+}
+
+int snapGet(struct snapReader *r, void *out, size_t length)
+{
+  if (r->failed || length > r->length - r->pos)
+  {
+    r->failed = 1;
+    memset(out, 0, length);
+    return -1;
+  }
+  memcpy(out, r->data + r->pos, length);
+  r->pos += length;
+  return 0;
+}
+
+uint32_t snapGetU32(struct snapReader *r)
+{
+  uint32_t v;
+  snapGet(r, &v, sizeof(v));
+  return v;
+}
+
+float snapGetFloat(struct snapReader *r)
+{
+  float v;
+  snapGet(r, &v, sizeof(v));
+  return v;
+}
+
+uint32_t snapGetVarint(struct snapReader *r)
+{
+  uint32_t v = 0;
+  for (int shift = 0; shift < 35; shift += 7)
+  {
+    unsigned char byte;
+    if (snapGet(r, &byte, 1))
+      return 0;
+    v |= (uint32_t)(byte & 0x7F) << shift;
+    if (!(byte & 0x80))
+      return v;
+  }
+  r->failed = 1;
+  return 0;
+}
+
+int32_t snapGetSigned(struct snapReader *r)
+{
+  uint32_t v = snapGetVarint(r);
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+int snapSaveFile(const char *path, const struct snapWriter *w)
+{
+  FILE *f = fopen(path, "wb");
+  if (!f)
+    return -1;
+  int ok = fwrite(w->data, 1, w->length, f) == w->length;
+  if (fclose(f) || !ok)
+    return -1;
+  return 0;
+}
+
+int snapLoadFile(const char *path, struct snapWriter *w)
+{
+  FILE *f = fopen(path, "rb");
+  if (!f)
+    return -1;
+  w->length = 0;
+  unsigned char buffer[65536];
+  size_t n;
+  while ((n = fread(buffer, 1, sizeof(buffer), f)) > 0)
+    snapPut(w, buffer, n);
+  int err = ferror(f) || w->failed;
+  fclose(f);
+  return err ? -1 : 0;
+}
+
+// Fill in a Unix socket address, -1 if the path doesn't fit
+static int socketAddress(struct sockaddr_un *addr, const char *path)
+{
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr->sun_path))
+    return -1;
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+int snapOutputOpen(struct snapOutput *out, const char *target)
+{
+  memset(out, 0, sizeof(*out));
+  out->listenFd = -1;
+  if (strncmp(target, SOCKETPREFIX, strlen(SOCKETPREFIX)))
+  {
+    out->file = fopen(target, "wb");
+    out->waiting[0] = 1;
+    return out->file ? 0 : -1;
+  }
+  const char *path = target + strlen(SOCKETPREFIX);
+  struct sockaddr_un addr;
+  if (socketAddress(&addr, path))
+    return -1;
+  out->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (out->listenFd == -1)
+    return -1;
+  // Left behind by a game that didn't close it
+  unlink(path);
+  if (bind(out->listenFd, (struct sockaddr *) &addr, sizeof(addr)) || listen(out->listenFd, SNAPMAXSPECTATORS))
+  {
+    snapOutputClose(out);
+    return -1;
+  }
+  fcntl(out->listenFd, F_SETFL, fcntl(out->listenFd, F_GETFL) | O_NONBLOCK);
+  strcpy(out->socketPath, path);
+  return 0;
+}
+
+int snapOutputClose(struct snapOutput *out)
+{
+  if (out->file)
+    fclose(out->file);
+  for (int i = 0; i < out->spectatorCount; ++i)
+    close(out->spectators[i]);
+  if (out->listenFd != -1)
+  {
+    close(out->listenFd);
+    unlink(out->socketPath);
+  }
+  memset(out, 0, sizeof(*out));
+  out->listenFd = -1;
+  return 0;
+}
+
+int snapOutputAccept(struct snapOutput *out)
+{
+  if (out->file)
+    return out->waiting[0];
+  int fd;
+  while (out->listenFd != -1 && (fd = accept(out->listenFd, NULL, NULL)) != -1)
+  {
+    if (out->spectatorCount == SNAPMAXSPECTATORS)
+    {
+      close(fd);
+      continue;
+    }
+    struct timeval timeout = { 0, SENDTIMEOUT * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    out->spectators[out->spectatorCount] = fd;
+    out->waiting[out->spectatorCount++] = 1;
+    logMessage(LOGLEVEL_INFO, "Spectator joined, %d watching", out->spectatorCount);
+  }
+  int waiting = 0;
+  for (int i = 0; i < out->spectatorCount; ++i)
+    waiting += out->waiting[i];
+  return waiting;
+}
+
+static int sendAll(int fd, const void *data, size_t length)
+{
+  const unsigned char *p = data;
+  while (length)
+  {
+    ssize_t n = send(fd, p, length, MSG_NOSIGNAL);
+    if (n <= 0)
+      return -1;
+    p += n;
+    length -= n;
+  }
+  return 0;
+}
+
+int snapOutputSend(struct snapOutput *out, int type, const struct snapWriter *w)
+{
+  if (w->failed)
+    return -1;
+  // Each record is its type, its length and then the record
+  unsigned char header[5] = { type };
+  uint32_t length = w->length;
+  memcpy(header + 1, &length, sizeof(length));
+  int keyframe = type == SNAP_KEYFRAME;
+  if (out->file)
+  {
+    if (out->waiting[0] != keyframe)
+      return 0;
+    out->waiting[0] = 0;
+    fwrite(header, 1, sizeof(header), out->file);
+    fwrite(w->data, 1, w->length, out->file);
+    out->sent += sizeof(header) + w->length;
+    return ferror(out->file) ? -1 : 0;
+  }
+  int got = 0;
+  for (int i = 0; i < out->spectatorCount; ++i)
+  {
+    if (out->waiting[i] != keyframe)
+      continue;
+    out->waiting[i] = 0;
+    if (!sendAll(out->spectators[i], header, sizeof(header)) && !sendAll(out->spectators[i], w->data, w->length))
+    {
+      got = 1;
+      continue;
+    }
+    close(out->spectators[i]);
+    out->spectatorCount--;
+    out->spectators[i] = out->spectators[out->spectatorCount];
+    out->waiting[i] = out->waiting[out->spectatorCount];
+    i--;
+    logMessage(LOGLEVEL_INFO, "Spectator dropped, %d watching", out->spectatorCount);
+  }
+  if (got)
+    out->sent += sizeof(header) + w->length;
+  return 0;
+}
+
+int snapInputOpen(struct snapInput *in, const char *source)
+{
+  memset(in, 0, sizeof(*in));
+  if (strncmp(source, SOCKETPREFIX, strlen(SOCKETPREFIX)))
+  {
+    in->file = fopen(source, "rb");
+    return in->file ? 0 : -1;
+  }
+  struct sockaddr_un addr;
+  if (socketAddress(&addr, source + strlen(SOCKETPREFIX)))
+    return -1;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1)
+    return -1;
+  if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) || !(in->file = fdopen(fd, "rb")))
+  {
+    close(fd);
+    return -1;
+  }
+  return 0;
+}
+
+int snapInputClose(struct snapInput *in)
+{
+  if (in->file)
+    fclose(in->file);
+  snapFree(&in->record);
+  memset(in, 0, sizeof(*in));
+  return 0;
+}
+
+int snapInputRead(struct snapInput *in, struct snapReader *r)
+{
+  unsigned char header[5];
+  uint32_t length;
+  if (fread(header, 1, sizeof(header), in->file) != sizeof(header))
+    return SNAP_END;
+  memcpy(&length, header + 1, sizeof(length));
+  in->record.length = 0;
+  unsigned char buffer[65536];
+  while (in->record.length < length)
+  {
+    size_t want = length - in->record.length < sizeof(buffer) ? length - in->record.length : sizeof(buffer);
+    if (fread(buffer, 1, want, in->file) != want || snapPut(&in->record, buffer, want))
+      return SNAP_END;
+  }
+  in->received += sizeof(header) + length;
+  *r = (struct snapReader){ in->record.data, in->record.length, 0, 0 };
+  return header[0] == SNAP_KEYFRAME || header[0] == SNAP_DELTA ? header[0] : SNAP_END;
+}
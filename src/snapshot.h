@@ -0,0 +1,86 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Spectators that can watch one game at once
+#define SNAPMAXSPECTATORS 8
+
+enum {SNAP_END, SNAP_KEYFRAME, SNAP_DELTA}; // Records in a snapshot stream, SNAP_END when there are no more
+
+// Bytes being put together, grows as needed. Running out of memory sets
+// failed and drops everything after.
+struct snapWriter
+{
+  unsigned char *data;
+  size_t length;
+  size_t capacity;
+  int failed;
+};
+
+// Bytes being taken apart. Reading past the end sets failed and gives zeroes.
+struct snapReader
+{
+  const unsigned char *data;
+  size_t length;
+  size_t pos;
+  int failed;
+};
+
+int snapFree(struct snapWriter *w);
+int snapPut(struct snapWriter *w, const void *data, size_t length);
+int snapPutU32(struct snapWriter *w, uint32_t v);
+int snapPutFloat(struct snapWriter *w, float v);
+// 7 bits a byte, small numbers take one
+int snapPutVarint(struct snapWriter *w, uint32_t v);
+// Varint of a number close to 0 either way
+int snapPutSigned(struct snapWriter *w, int32_t v);
+int snapGet(struct snapReader *r, void *out, size_t length);
+uint32_t snapGetU32(struct snapReader *r);
+float snapGetFloat(struct snapReader *r);
+uint32_t snapGetVarint(struct snapReader *r);
+int32_t snapGetSigned(struct snapReader *r);
+
+// Write a save-state out, or read one back into w
+int snapSaveFile(const char *path, const struct snapWriter *w);
+int snapLoadFile(const char *path, struct snapWriter *w);
+
+// Where a game's records go: a file, or the spectators connected to a
+// Unix socket when the target is unix:path. A spectator that can't keep
+// up is dropped rather than holding the game up.
+struct snapOutput
+{
+  FILE *file;
+  int listenFd;
+  char socketPath[256];
+  int spectators[SNAPMAXSPECTATORS];
+  int waiting[SNAPMAXSPECTATORS]; // Hasn't had a keyframe yet
+  int spectatorCount;
+  size_t sent; // Bytes of the records that went to the file or any spectator
+};
+
+int snapOutputOpen(struct snapOutput *out, const char *target);
+int snapOutputClose(struct snapOutput *out);
+// Let in spectators that connected since last time, returns how many are
+// waiting for a keyframe (the file waits for one until it has had one)
+int snapOutputAccept(struct snapOutput *out);
+// Send a record. Keyframes only go to those waiting for one, deltas only to
+// the rest.
+int snapOutputSend(struct snapOutput *out, int type, const struct snapWriter *w);
+
+// Where a spectator's records come from, a file or unix:path
+struct snapInput
+{
+  FILE *file;
+  struct snapWriter record;
+  size_t received;
+};
+
+int snapInputOpen(struct snapInput *in, const char *source);
+int snapInputClose(struct snapInput *in);
+// Wait for the next record and point r at it, returns its type
+int snapInputRead(struct snapInput *in, struct snapReader *r);
+
+#endif /* SNAPSHOT_H */
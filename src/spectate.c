@@ -0,0 +1,439 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gen.h"
+#include "replay.h"
+#include "spectate.h"
+
+int viewInit(struct spectateView *view, int capacity)
+{
+  viewFree(view);
+  view->capacity = capacity;
+  view->x = calloc(capacity, sizeof(int));
+  view->y = calloc(capacity, sizeof(int));
+  view->shown = calloc(capacity, 1);
+  view->nextX = calloc(capacity, sizeof(int));
+  view->nextY = calloc(capacity, sizeof(int));
+  view->nextShown = calloc(capacity, 1);
+  view->prevX = calloc(capacity, sizeof(int));
+  view->prevY = calloc(capacity, sizeof(int));
+  view->resync = 1;
+  if (!view->x || !view->y || !view->shown || !view->nextX || !view->nextY || !view->nextShown || !view->prevX || !view->prevY)
+  {
+    fprintf(stderr, "Not enough memory to keep track of spectators\n");
+    return -1;
+  }
+  return 0;
+}
+
+int viewFree(struct spectateView *view)
+{
+  int *ints[] = { view->x, view->y, view->nextX, view->nextY, view->prevX, view->prevY };
+  for (unsigned int i = 0; i < sizeof(ints) / sizeof(ints[0]); ++i)
+    free(ints[i]);
+  free(view->shown);
+  free(view->nextShown);
+  free(view->tiles);
+  memset(view, 0, sizeof(*view));
+  return 0;
+}
+
+// A position in the 1/SPECTATESCALE tiles spectators get
+static int quantize(float v)
+{
+  return (int) floorf(v * SPECTATESCALE + 0.5f);
+}
+
+static int compareTiles(const void *a, const void *b)
+{
+  const struct tileCoord *s = a, *t = b;
+  if (s->x != t->x) return s->x < t->x ? -1 : 1;
+  return (s->y > t->y) - (s->y < t->y);
+}
+
+// What a spectator should have after a record, to catch it going wrong
+static uint32_t viewChecksum(const struct spectateView *view, Vector2 pos)
+{
+  uint32_t hash = 2166136261u;
+  int base[2] = { quantize(pos.x), quantize(pos.y) };
+  hash = replayHash(hash, base, sizeof(base));
+  for (int s = 0; s < view->capacity; ++s)
+    if (view->shown[s])
+    {
+      int zombie[3] = { s, view->x[s], view->y[s] };
+      hash = replayHash(hash, zombie, sizeof(zombie));
+    }
+  return hash;
+}
+
+// Whether chunk (x, y) is in the window side chunks across from (originX, originY)
+static int inWindow(int x, int y, int originX, int originY, int side)
+{
+  return (unsigned int)(x - originX) < (unsigned int) side && (unsigned int)(y - originY) < (unsigned int) side;
+}
+
+// A record: the player, the window and the chunks that came into it (all of
+// them for a keyframe, or after a new game), runs of tiles that changed,
+// then the zombies near the player that moved, came or went. Zombies go by
+// handle slot, each one as the gap from the last slot and how far it moved
+// since it was last sent. A zombie at full speed moves under 8 steps
+// between records, so that usually fits in a byte as two nibbles and most
+// zombies take two bytes.
+int viewWrite(struct spectateView *view, struct snapWriter *w, const struct spectateGame *game, const struct spectatePlayer *player, int keyframe)
+{
+  int chunksFull = keyframe || view->resync;
+  unsigned char flags = chunksFull | (player->facing << 1) | (player->moving << 2) | (player->dead << 3) | (player->ready << 4);
+  snapPut(w, &flags, 1);
+  snapPutVarint(w, player->frame);
+  snapPut(w, &player->pos, sizeof(player->pos));
+  snapPut(w, &player->aim, sizeof(player->aim));
+  snapPutVarint(w, player->kills);
+
+  int originX = *game->originX, originY = *game->originY, side = game->side;
+  snapPutSigned(w, originX);
+  snapPutSigned(w, originY);
+  unsigned char packed[CHUNKPACKMAX];
+  for (int y = originY; y < originY + side; ++y)
+    for (int x = originX; x < originX + side; ++x)
+    {
+      if (!chunksFull && inWindow(x, y, view->originX, view->originY, side))
+        continue;
+      // The spectator makes the untouched ones itself
+      const struct mapChunk *chunk = game->chunk(x, y, 0);
+      snapPut(w, &chunk->edited, 1);
+      if (!chunk->edited)
+        continue;
+      int length = chunkPack(chunk, packed);
+      snapPutVarint(w, length);
+      snapPut(w, packed, length);
+    }
+  view->originX = originX;
+  view->originY = originY;
+  view->resync = 0;
+
+  // Changed tiles in order, dropping repeats and ones that left the window
+  struct tileCoord *tiles = view->tiles;
+  int n = 0;
+  if (!keyframe)
+  {
+    // tiles is NULL until the first one is noted
+    if (view->tileCount)
+      qsort(tiles, view->tileCount, sizeof(*tiles), compareTiles);
+    for (int i = 0; i < view->tileCount; ++i)
+      if ((!n || compareTiles(&tiles[i], &tiles[n - 1])) && game->tile(tiles[i], NULL))
+        tiles[n++] = tiles[i];
+    view->tileCount = 0;
+  }
+  int runs = 0;
+  for (int i = 0; i < n; ++i)
+    runs += !i || tiles[i].x != tiles[i - 1].x || tiles[i].y != tiles[i - 1].y + 1;
+  snapPutVarint(w, runs);
+  struct tileCoord last = { 0, 0 };
+  for (int i = 0, length; i < n; i += length)
+  {
+    for (length = 1; i + length < n && tiles[i + length].x == tiles[i].x && tiles[i + length].y == tiles[i].y + length; ++length);
+    snapPutSigned(w, tiles[i].x - last.x);
+    snapPutSigned(w, tiles[i].y - last.y);
+    snapPutVarint(w, length);
+    for (int k = 0; k < length; ++k)
+      snapPut(w, game->tile(tiles[i + k], NULL), 1);
+    last = tiles[i];
+  }
+
+  // A zombie that wasn't shown before moves from the player's position
+  const struct horde *horde = game->horde;
+  int baseX = quantize(player->pos.x), baseY = quantize(player->pos.y);
+  if (!keyframe)
+  {
+    memset(view->nextShown, 0, view->capacity);
+    for (int i = 0; i < horde->count; ++i)
+    {
+      if (fabsf(horde->x[i] - player->pos.x) > SPECTATEREACHX || fabsf(horde->y[i] - player->pos.y) > SPECTATEREACHY)
+        continue;
+      int s = horde->handle[i] & HANDLESLOTMASK;
+      view->nextShown[s] = 1;
+      view->nextX[s] = quantize(horde->x[i]);
+      view->nextY[s] = quantize(horde->y[i]);
+    }
+  }
+  int removed = 0, changed = 0;
+  for (int s = 0; s < view->capacity; ++s)
+    if (keyframe)
+      changed += view->shown[s];
+    else
+    {
+      removed += view->shown[s] && !view->nextShown[s];
+      changed += view->nextShown[s] && (!view->shown[s] || view->nextX[s] != view->x[s] || view->nextY[s] != view->y[s]);
+    }
+  snapPutVarint(w, removed);
+  for (int s = 0, lastSlot = 0; s < view->capacity && removed; ++s)
+    if (view->shown[s] && !view->nextShown[s])
+    {
+      snapPutVarint(w, s - lastSlot);
+      lastSlot = s;
+      view->shown[s] = 0;
+    }
+  snapPutVarint(w, changed);
+  for (int s = 0, lastSlot = 0; s < view->capacity && changed; ++s)
+  {
+    int moved = keyframe ? view->shown[s] : view->nextShown[s] && (!view->shown[s] || view->nextX[s] != view->x[s] || view->nextY[s] != view->y[s]);
+    if (!moved)
+      continue;
+    int fromX = view->shown[s] && !keyframe ? view->x[s] : baseX, fromY = view->shown[s] && !keyframe ? view->y[s] : baseY;
+    int toX = keyframe ? view->x[s] : view->nextX[s], toY = keyframe ? view->y[s] : view->nextY[s];
+    // The bottom bit of the gap says whether the move is in nibbles
+    int dx = toX - fromX, dy = toY - fromY;
+    int small = dx >= -8 && dx < 8 && dy >= -8 && dy < 8;
+    snapPutVarint(w, (s - lastSlot) << 1 | small);
+    if (small)
+    {
+      unsigned char nibbles = (dx + 8) | (dy + 8) << 4;
+      snapPut(w, &nibbles, 1);
+    }
+    else
+    {
+      snapPutSigned(w, dx);
+      snapPutSigned(w, dy);
+    }
+    lastSlot = s;
+    view->shown[s] = 1;
+    view->x[s] = toX;
+    view->y[s] = toY;
+  }
+  snapPutU32(w, viewChecksum(view, player->pos));
+  return w->failed ? -1 : 0;
+}
+
+int viewRead(struct spectateView *view, struct snapReader *r, struct spectateGame *game, struct spectatePlayer *player, int keyframe)
+{
+  unsigned char flags;
+  snapGet(r, &flags, 1);
+  int chunksFull = flags & 1;
+  player->facing = flags >> 1 & 1;
+  player->moving = flags >> 2 & 1;
+  player->dead = flags >> 3 & 1;
+  player->ready = flags >> 4 & 1;
+  player->jumped = chunksFull;
+  player->frame = snapGetVarint(r);
+  snapGet(r, &player->pos, sizeof(player->pos));
+  snapGet(r, &player->aim, sizeof(player->aim));
+  player->kills = snapGetVarint(r);
+
+  // Hand back the chunks that left and make or unpack the ones that came
+  int oldX = *game->originX, oldY = *game->originY, side = game->side;
+  int originX = *game->originX = snapGetSigned(r);
+  int originY = *game->originY = snapGetSigned(r);
+  unsigned char packed[CHUNKPACKMAX];
+  struct mapChunk *fresh[ACTIVESIDEMAX * ACTIVESIDEMAX];
+  int freshCount = 0;
+  for (int y = originY; y < originY + side && !r->failed; ++y)
+    for (int x = originX; x < originX + side && !r->failed; ++x)
+    {
+      if (!chunksFull && inWindow(x, y, oldX, oldY, side))
+        continue;
+      struct mapChunk *chunk = game->chunk(x, y, 1);
+      unsigned char edited;
+      snapGet(r, &edited, 1);
+      if (!edited)
+      {
+        fresh[freshCount++] = chunk;
+        continue;
+      }
+      uint32_t length = snapGetVarint(r);
+      if (length > CHUNKPACKMAX || snapGet(r, packed, length) || chunkUnpack(chunk, packed, length))
+        r->failed = 1;
+      chunk->edited = 1;
+    }
+  genChunks(fresh, freshCount, game->seed);
+
+  uint32_t runs = snapGetVarint(r);
+  struct tileCoord last = { 0, 0 };
+  for (uint32_t i = 0; i < runs && !r->failed; ++i)
+  {
+    last.x += snapGetSigned(r);
+    last.y += snapGetSigned(r);
+    uint32_t length = snapGetVarint(r);
+    if (length > r->length)
+      r->failed = 1;
+    for (uint32_t k = 0; k < length && !r->failed; ++k)
+    {
+      char value;
+      snapGet(r, &value, 1);
+      game->setTile((Vector2){ last.x + 0.5f, last.y + k + 0.5f }, value);
+    }
+  }
+
+  // Zombies that didn't move stay where they are between records
+  if (keyframe)
+    memset(view->shown, 0, view->capacity);
+  for (int s = 0; s < view->capacity; ++s)
+  {
+    view->prevX[s] = view->x[s];
+    view->prevY[s] = view->y[s];
+  }
+  int baseX = quantize(player->pos.x), baseY = quantize(player->pos.y);
+  uint32_t removed = snapGetVarint(r);
+  for (uint32_t i = 0, s = 0; i < removed && !r->failed; ++i)
+  {
+    s += snapGetVarint(r);
+    if (s >= (uint32_t) view->capacity)
+      r->failed = 1;
+    else
+      view->shown[s] = 0;
+  }
+  uint32_t changed = snapGetVarint(r);
+  for (uint32_t i = 0, s = 0; i < changed && !r->failed; ++i)
+  {
+    uint32_t gap = snapGetVarint(r);
+    s += gap >> 1;
+    int dx, dy;
+    if (gap & 1)
+    {
+      unsigned char nibbles = 0;
+      snapGet(r, &nibbles, 1);
+      dx = (nibbles & 15) - 8;
+      dy = (nibbles >> 4) - 8;
+    }
+    else
+    {
+      dx = snapGetSigned(r);
+      dy = snapGetSigned(r);
+    }
+    if (s >= (uint32_t) view->capacity)
+    {
+      r->failed = 1;
+      break;
+    }
+    if (!view->shown[s])
+    {
+      view->prevX[s] = view->x[s] = baseX + dx;
+      view->prevY[s] = view->y[s] = baseY + dy;
+    }
+    else
+    {
+      view->x[s] += dx;
+      view->y[s] += dy;
+    }
+    view->shown[s] = 1;
+  }
+  uint32_t checksum = snapGetU32(r);
+  if (r->failed)
+    return -1;
+
+  // Draw them with the horde like the game does, by slot so each keeps its
+  // animation phase
+  struct horde *horde = game->horde;
+  horde->count = 0;
+  for (int s = 0; s < view->capacity; ++s)
+    if (view->shown[s])
+    {
+      int i = horde->count++;
+      // Everything jumps after a new game instead of sliding across
+      int fromX = chunksFull ? view->x[s] : view->prevX[s], fromY = chunksFull ? view->y[s] : view->prevY[s];
+      horde->x[i] = view->x[s] / (float) SPECTATESCALE;
+      horde->y[i] = view->y[s] / (float) SPECTATESCALE;
+      horde->prevX[i] = fromX / (float) SPECTATESCALE;
+      horde->prevY[i] = fromY / (float) SPECTATESCALE;
+      horde->handle[i] = s;
+    }
+  return checksum != viewChecksum(view, player->pos);
+}
+
+int spectateBroadcastOpen(struct spectateBroadcast *b, const char *target, int capacity, int every)
+{
+  memset(b, 0, sizeof(*b));
+  b->every = every > 0 ? every : 1;
+  if (viewInit(&b->view, capacity))
+    return -1;
+  return snapOutputOpen(&b->out, target);
+}
+
+int spectateBroadcastClose(struct spectateBroadcast *b)
+{
+  snapOutputClose(&b->out);
+  snapFree(&b->record);
+  return viewFree(&b->view);
+}
+
+int spectateBroadcastTick(struct spectateBroadcast *b, const struct spectateGame *game, const struct spectatePlayer *player,
+                          const void *header, size_t headerLength)
+{
+  if (player->frame % b->every)
+    return 0;
+  struct snapWriter *w = &b->record;
+  int waiting = snapOutputAccept(&b->out);
+  w->length = 0;
+  viewWrite(&b->view, w, game, player, 0);
+  snapOutputSend(&b->out, SNAP_DELTA, w);
+  if (!waiting)
+    return 0;
+  w->length = 0;
+  snapPut(w, header, headerLength);
+  viewWrite(&b->view, w, game, player, 1);
+  return snapOutputSend(&b->out, SNAP_KEYFRAME, w);
+}
+
+int spectateNoteTile(struct spectateBroadcast *b, struct tileCoord t)
+{
+  struct spectateView *view = &b->view;
+  // Not open yet (the walls a scenario starts with), the first record
+  // sends the chunks whole anyway
+  if (!view->capacity)
+    return 0;
+  if (view->tileCount == view->tileCapacity)
+  {
+    int capacity = view->tileCapacity ? view->tileCapacity * 2 : 64;
+    struct tileCoord *grown = realloc(view->tiles, sizeof(*grown) * capacity);
+    if (!grown)
+      return -1;
+    view->tiles = grown;
+    view->tileCapacity = capacity;
+  }
+  view->tiles[view->tileCount++] = t;
+  return 0;
+}
+
+int spectateOpen(struct spectateClient *c, const char *source, void *header, size_t headerLength)
+{
+  memset(c, 0, sizeof(*c));
+  if (snapInputOpen(&c->in, source))
+  {
+    fprintf(stderr, "Could not spectate: %s\n", source);
+    return -1;
+  }
+  if (snapInputRead(&c->in, &c->r) != SNAP_KEYFRAME || snapGet(&c->r, header, headerLength))
+  {
+    fprintf(stderr, "Not a game to spectate: %s\n", source);
+    return -1;
+  }
+  return 0;
+}
+
+int spectateClose(struct spectateClient *c)
+{
+  snapInputClose(&c->in);
+  return viewFree(&c->view);
+}
+
+int spectateNext(struct spectateClient *c, struct spectateGame *game, struct spectatePlayer *player)
+{
+  int type = SNAP_KEYFRAME;
+  if (!c->started)
+  {
+    // The first keyframe was read by spectateOpen, the horde is sized now
+    c->started = 1;
+    if (viewInit(&c->view, game->horde->capacity))
+      return SNAP_END;
+  }
+  else if ((type = snapInputRead(&c->in, &c->r)) == SNAP_END || c->broken)
+    return SNAP_END;
+  int result = viewRead(&c->view, &c->r, game, player, type == SNAP_KEYFRAME);
+  if (result == -1)
+  {
+    c->broken = 1;
+    return SNAP_END;
+  }
+  c->mismatches += result;
+  c->records++;
+  return type;
+}
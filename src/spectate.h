@@ -0,0 +1,111 @@
+#ifndef SPECTATE_H
+#define SPECTATE_H
+
+#include <raylib.h>
+#include "horde.h"
+#include "snapshot.h"
+#include "world.h"
+
+// Records sent to spectators a second, frames are drawn between them
+#define SPECTATERATE 10
+// Spectators get zombie positions in steps of 1/SPECTATESCALE tiles
+#define SPECTATESCALE 8
+// Zombies this many tiles either way of the player are sent to spectators,
+// a bit more than the screen shows
+#define SPECTATEREACHX 24
+#define SPECTATEREACHY 14
+
+// The player's side of a record, filled in by the game when sending and
+// by spectateNext when watching
+struct spectatePlayer
+{
+  unsigned int frame; // Ticks since the game started
+  Vector2 pos;
+  Vector2 aim;
+  int kills;
+  int facing, moving, dead, ready; // ready: the shotgun can fire
+  int jumped; // Watching: a new game or keyframe, don't slide from the last pos
+};
+
+// How records get at the game. The window is the active chunks, the horde
+// is read when sending and filled in with what's in view when watching.
+struct spectateGame
+{
+  struct horde *horde;
+  int *originX, *originY; // Chunk in the top left corner of the window
+  int side;               // Chunks across the window
+  unsigned int seed;      // Chunks nobody changed are generated from this
+  // The active chunk at (x, y). With swap set the one there is handed back
+  // and a blank one put in its place, for a spectator to fill in.
+  struct mapChunk *(*chunk)(int x, int y, int swap);
+  char *(*tile)(struct tileCoord tile, int *slot); // NULL if not in the window
+  int (*setTile)(Vector2 pos, char value);
+};
+
+// What spectators have been sent (or, watching, what was received) so each
+// record only holds what changed. Zombies are kept by handle slot, with
+// positions in 1/SPECTATESCALE tiles.
+struct spectateView
+{
+  int capacity;
+  int *x, *y;
+  char *shown;
+  int *nextX, *nextY; // Sending: where the zombies are now
+  char *nextShown;
+  int *prevX, *prevY; // Watching: where they were a record ago
+  int originX, originY; // Window the spectator has the chunks of
+  int resync;           // The spectator needs every chunk again
+  struct tileCoord *tiles; // Changed since the last record
+  int tileCount, tileCapacity;
+};
+
+// Size a view for a horde of capacity, forgetting what was sent
+int viewInit(struct spectateView *view, int capacity);
+int viewFree(struct spectateView *view);
+// Write a record of what changed since the last one, or for a keyframe
+// everything the view already has
+int viewWrite(struct spectateView *view, struct snapWriter *w, const struct spectateGame *game, const struct spectatePlayer *player, int keyframe);
+// Apply a record from viewWrite. Returns 1 if the checksum at the end
+// didn't match what the spectator ended up with, -1 if it is broken.
+int viewRead(struct spectateView *view, struct snapReader *r, struct spectateGame *game, struct spectatePlayer *player, int keyframe);
+
+// A game being sent to --broadcast. A new spectator gets a keyframe behind
+// the header the game gives, the rest get deltas every few ticks.
+struct spectateBroadcast
+{
+  struct snapOutput out;
+  struct snapWriter record;
+  struct spectateView view;
+  int every; // Ticks between records
+};
+
+int spectateBroadcastOpen(struct spectateBroadcast *b, const char *target, int capacity, int every);
+int spectateBroadcastClose(struct spectateBroadcast *b);
+// Call after every tick. Deltas carry on from what was last sent, so they
+// are worked out even while nobody is watching.
+int spectateBroadcastTick(struct spectateBroadcast *b, const struct spectateGame *game, const struct spectatePlayer *player,
+                          const void *header, size_t headerLength);
+// Note a changed tile for the next record
+int spectateNoteTile(struct spectateBroadcast *b, struct tileCoord t);
+
+// Watching a --broadcast from a file or unix:path
+struct spectateClient
+{
+  struct snapInput in;
+  struct snapReader r;
+  struct spectateView view;
+  int records;    // Applied so far
+  int mismatches; // Ones that didn't end up like the game
+  int broken;     // Stopped at a record that couldn't be read
+  int started;
+};
+
+// Connect and read the game's header (headerLength bytes) from its first
+// keyframe, the world is opened from it before spectateNext
+int spectateOpen(struct spectateClient *c, const char *source, void *header, size_t headerLength);
+int spectateClose(struct spectateClient *c);
+// Apply the next record to the game, the first keyframe first. Returns its
+// type, SNAP_END once the game is over or a record is broken.
+int spectateNext(struct spectateClient *c, struct spectateGame *game, struct spectatePlayer *player);
+
+#endif /* SPECTATE_H */
@@ -0,0 +1,235 @@
+#include <string.h>
+#include "gen.h"
+#include "log.h"
+#include "stream.h"
+
+// Get a chunk out of the cache, or the region files if it fell out of the
+// cache, or generate it if it was never edited
+static struct mapChunk *loadChunkData(struct chunkStream *stream, int x, int y)
+{
+  struct mapChunk *chunk = cacheTake(stream->cache, x, y);
+  if (chunk)
+  {
+    logMessage(LOGLEVEL_DEBUG, "Chunk found: %d, %d", x, y);
+    return chunk;
+  }
+  unsigned char packed[CHUNKPACKMAX];
+  int length = regionLoad(stream->store, x, y, packed, sizeof(packed));
+  chunk = cacheNewChunk(stream->cache, x, y);
+  if (length > 0 && !chunkUnpack(chunk, packed, length))
+  {
+    logMessage(LOGLEVEL_DEBUG, "Chunk loaded from disk: %d, %d", x, y);
+    chunk->edited = 1;
+  }
+  else
+  {
+    logMessage(LOGLEVEL_DEBUG, "Chunk generated: %d, %d", x, y);
+    genChunks(&chunk, 1, stream->seed);
+  }
+  return chunk;
+}
+
+static int runRequest(struct chunkStream *stream, struct streamRequest *request)
+{
+  if (request->type == STREAM_STORE)
+    cachePut(stream->cache, request->chunk);
+  else
+    request->chunk = loadChunkData(stream, request->x, request->y);
+  return 0;
+}
+
+static void *streamMain(void *arg)
+{
+  struct chunkStream *stream = arg;
+  pthread_mutex_lock(&stream->lock);
+  for (;;)
+  {
+    while (!stream->requestCount && !stream->quit)
+      pthread_cond_wait(&stream->wake, &stream->lock);
+    // Quitting still finishes what was asked for
+    if (!stream->requestCount) break;
+    struct streamRequest request = stream->requests[stream->requestHead];
+    stream->requestHead = (stream->requestHead + 1) % STREAMQUEUE;
+    stream->requestCount--;
+    stream->busy = 1;
+    pthread_mutex_unlock(&stream->lock);
+    runRequest(stream, &request);
+    pthread_mutex_lock(&stream->lock);
+    stream->busy = 0;
+    // There are never more loads on the way than ready slots, so this fits
+    if (request.type == STREAM_LOAD)
+      stream->loaded[stream->loadedCount++] = request;
+    pthread_cond_broadcast(&stream->done);
+  }
+  pthread_mutex_unlock(&stream->lock);
+  return NULL;
+}
+
+int streamInit(struct chunkStream *stream, struct chunkCache *cache, struct regionStore *store)
+{
+  memset(stream, 0, sizeof(*stream));
+  stream->cache = cache;
+  stream->store = store;
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->wake, NULL);
+  pthread_cond_init(&stream->done, NULL);
+  // Without the thread every request is done straight away instead
+  if (pthread_create(&stream->thread, NULL, streamMain, stream))
+    logMessage(LOGLEVEL_WARN, "Could not start the streaming thread, chunks load on the main thread");
+  else
+    stream->running = 1;
+  return 0;
+}
+
+int streamFree(struct chunkStream *stream)
+{
+  if (stream->running)
+  {
+    pthread_mutex_lock(&stream->lock);
+    stream->quit = 1;
+    pthread_cond_signal(&stream->wake);
+    pthread_mutex_unlock(&stream->lock);
+    pthread_join(stream->thread, NULL);
+  }
+  pthread_mutex_destroy(&stream->lock);
+  pthread_cond_destroy(&stream->wake);
+  pthread_cond_destroy(&stream->done);
+  stream->running = 0;
+  return 0;
+}
+
+// Queue a request, waiting for room if the queue is full
+static int pushRequest(struct chunkStream *stream, struct streamRequest request)
+{
+  if (!stream->running)
+  {
+    runRequest(stream, &request);
+    if (request.type == STREAM_LOAD)
+      stream->loaded[stream->loadedCount++] = request;
+    return 0;
+  }
+  pthread_mutex_lock(&stream->lock);
+  while (stream->requestCount == STREAMQUEUE)
+    pthread_cond_wait(&stream->done, &stream->lock);
+  stream->requests[(stream->requestHead + stream->requestCount) % STREAMQUEUE] = request;
+  stream->requestCount++;
+  pthread_cond_signal(&stream->wake);
+  pthread_mutex_unlock(&stream->lock);
+  return 0;
+}
+
+// Match up finished loads with the ready slots waiting for them, waiting
+// for at least one if wait is set. Call with the lock held.
+static int collectLoaded(struct chunkStream *stream, int wait)
+{
+  while (wait && !stream->loadedCount && stream->running)
+    pthread_cond_wait(&stream->done, &stream->lock);
+  for (int i = 0; i < stream->loadedCount; ++i)
+    for (int r = 0; r < stream->readyCount; ++r)
+      if (!stream->ready[r].chunk && stream->ready[r].x == stream->loaded[i].x && stream->ready[r].y == stream->loaded[i].y)
+      {
+        stream->ready[r].chunk = stream->loaded[i].chunk;
+        break;
+      }
+  stream->loadedCount = 0;
+  return 0;
+}
+
+static int findReady(const struct chunkStream *stream, int x, int y)
+{
+  for (int r = 0; r < stream->readyCount; ++r)
+    if (stream->ready[r].x == x && stream->ready[r].y == y)
+      return r;
+  return -1;
+}
+
+static int removeReady(struct chunkStream *stream, int r)
+{
+  stream->readyCount--;
+  memmove(&stream->ready[r], &stream->ready[r + 1], sizeof(stream->ready[0]) * (stream->readyCount - r));
+  return 0;
+}
+
+// Free up a ready slot by storing the oldest chunk nobody took, waiting for
+// a load to finish if they are all still on their way
+static int makeRoom(struct chunkStream *stream)
+{
+  if (stream->readyCount < STREAMREADY)
+    return 0;
+  pthread_mutex_lock(&stream->lock);
+  collectLoaded(stream, 0);
+  int r;
+  for (;;)
+  {
+    for (r = 0; r < stream->readyCount && !stream->ready[r].chunk; ++r);
+    if (r < stream->readyCount) break;
+    collectLoaded(stream, 1);
+  }
+  pthread_mutex_unlock(&stream->lock);
+  struct mapChunk *chunk = stream->ready[r].chunk;
+  removeReady(stream, r);
+  return streamStore(stream, chunk);
+}
+
+int streamWait(struct chunkStream *stream)
+{
+  pthread_mutex_lock(&stream->lock);
+  while (stream->requestCount || stream->busy)
+    pthread_cond_wait(&stream->done, &stream->lock);
+  collectLoaded(stream, 0);
+  pthread_mutex_unlock(&stream->lock);
+  // Every load has finished, so every ready slot has its chunk. They go
+  // back in the cache, an edited one would be in neither the cache nor the
+  // window otherwise.
+  for (int r = 0; r < stream->readyCount; ++r)
+    cachePut(stream->cache, stream->ready[r].chunk);
+  stream->readyCount = 0;
+  return 0;
+}
+
+int streamReset(struct chunkStream *stream, unsigned int seed)
+{
+  streamWait(stream);
+  stream->seed = seed;
+  return 0;
+}
+
+int streamStore(struct chunkStream *stream, struct mapChunk *chunk)
+{
+  return pushRequest(stream, (struct streamRequest){ STREAM_STORE, (int) chunk->pos.x, (int) chunk->pos.y, chunk });
+}
+
+int streamPrefetch(struct chunkStream *stream, int x, int y)
+{
+  if (findReady(stream, x, y) != -1)
+    return 0;
+  makeRoom(stream);
+  stream->ready[stream->readyCount++] = (struct streamRequest){ STREAM_LOAD, x, y, NULL };
+  stream->prefetched++;
+  return pushRequest(stream, (struct streamRequest){ STREAM_LOAD, x, y, NULL });
+}
+
+struct mapChunk *streamTake(struct chunkStream *stream, int x, int y)
+{
+  int r = findReady(stream, x, y);
+  int prefetched = r != -1;
+  if (!prefetched)
+  {
+    makeRoom(stream);
+    r = stream->readyCount++;
+    stream->ready[r] = (struct streamRequest){ STREAM_LOAD, x, y, NULL };
+    pushRequest(stream, stream->ready[r]);
+  }
+  pthread_mutex_lock(&stream->lock);
+  collectLoaded(stream, 0);
+  if (prefetched && stream->ready[r].chunk)
+    stream->hits++;
+  else
+    stream->stalls++;
+  while (!stream->ready[r].chunk)
+    collectLoaded(stream, 1);
+  pthread_mutex_unlock(&stream->lock);
+  struct mapChunk *chunk = stream->ready[r].chunk;
+  removeReady(stream, r);
+  return chunk;
+}
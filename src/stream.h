@@ -0,0 +1,75 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <pthread.h>
+#include "region.h"
+#include "world.h"
+
+// Requests that can wait for the streaming thread at once
+#define STREAMQUEUE 32
+// Chunks loaded ahead of being needed, or on their way, enough for a row
+// and a column of the widest active window
+#define STREAMREADY (2 * ACTIVESIDEMAX + 2)
+
+enum {STREAM_LOAD, STREAM_STORE}; // What a request asks for
+
+struct streamRequest
+{
+  int type;
+  int x, y;
+  struct mapChunk *chunk; // The chunk to store, or the one loaded
+};
+
+// Moves chunks in and out of the chunk cache and the region files on a
+// thread of its own, so the tick only swaps pointers. While it runs the
+// cache and the store belong to that thread, anything else has to
+// streamWait first. Requests are done in order, so loading a chunk right
+// after storing it gets it back. Once STREAMQUEUE requests are waiting the
+// next one blocks until the thread has finished one.
+struct chunkStream
+{
+  struct chunkCache *cache;
+  struct regionStore *store;
+  unsigned int seed; // Chunks that were never stored are generated from this
+  pthread_t thread;
+  int running;
+  pthread_mutex_t lock;
+  pthread_cond_t wake; // A request came in, or it's time to quit
+  pthread_cond_t done; // A request was finished
+  int quit;
+  int busy;
+  struct streamRequest requests[STREAMQUEUE];
+  int requestHead, requestCount;
+  struct streamRequest loaded[STREAMQUEUE];
+  int loadedCount;
+  // Only touched by the thread using the stream: chunks asked for and not
+  // yet taken, oldest first, chunk is NULL until it has been loaded
+  struct streamRequest ready[STREAMREADY];
+  int readyCount;
+  int prefetched; // Chunks asked for ahead of time
+  int hits;       // Taken without waiting
+  int stalls;     // Had to wait for the streaming thread
+};
+
+// Start the streaming thread for a cache and the store behind it. The
+// cache's pool has to hold STREAMREADY chunks on top of the active ones.
+int streamInit(struct chunkStream *stream, struct chunkCache *cache, struct regionStore *store);
+// Finish every request and stop the thread
+int streamFree(struct chunkStream *stream);
+// Wait until every request is done and put the chunks loaded ahead back
+// in the cache, after which the cache and the store can be used directly
+// until the next request
+int streamWait(struct chunkStream *stream);
+// streamWait, for when the cache is about to be reset for a new world
+// made from seed
+int streamReset(struct chunkStream *stream, unsigned int seed);
+// Hand over a chunk that is no longer active to be packed into the cache
+int streamStore(struct chunkStream *stream, struct mapChunk *chunk);
+// Start loading a chunk that will be needed soon, does nothing if it
+// already has been
+int streamPrefetch(struct chunkStream *stream, int x, int y);
+// Get a chunk to make active, waiting for it if it isn't loaded yet. A
+// chunk that was never stored comes back freshly generated.
+struct mapChunk *streamTake(struct chunkStream *stream, int x, int y);
+
+#endif /* STREAM_H */
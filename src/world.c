@@ -0,0 +1,336 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "world.h"
+
+static int tableHome(const struct chunkCache *cache, int x, int y)
+{
+  unsigned int h = (unsigned int) x * 73856093u ^ (unsigned int) y * 19349663u;
+  return (int)(h & (unsigned int) cache->tableMask);
+}
+
+static int tableFind(const struct chunkCache *cache, int x, int y)
+{
+  for (int i = tableHome(cache, x, y); cache->table[i]; i = (i + 1) & cache->tableMask)
+    if (cache->table[i]->x == x && cache->table[i]->y == y)
+      return i;
+  return -1;
+}
+
+static int tableInsert(struct chunkCache *cache, struct cachedChunk *chunk)
+{
+  int i = tableHome(cache, chunk->x, chunk->y);
+  while (cache->table[i])
+    i = (i + 1) & cache->tableMask;
+  cache->table[i] = chunk;
+  return i;
+}
+
+// Linear probing delete that shifts later entries back instead of leaving
+// tombstones, so lookups never get slower as chunks come and go
+static int tableRemove(struct chunkCache *cache, int i)
+{
+  int mask = cache->tableMask;
+  cache->table[i] = NULL;
+  for (int j = (i + 1) & mask; cache->table[j]; j = (j + 1) & mask)
+  {
+    int home = tableHome(cache, cache->table[j]->x, cache->table[j]->y);
+    if (((j - home) & mask) >= ((j - i) & mask))
+    {
+      cache->table[i] = cache->table[j];
+      cache->table[j] = NULL;
+      i = j;
+    }
+  }
+  return 0;
+}
+
+static int lruUnlink(struct chunkCache *cache, struct cachedChunk *chunk)
+{
+  if (chunk->lruPrev) chunk->lruPrev->lruNext = chunk->lruNext;
+  else cache->lruHead = chunk->lruNext;
+  if (chunk->lruNext) chunk->lruNext->lruPrev = chunk->lruPrev;
+  else cache->lruTail = chunk->lruPrev;
+  chunk->lruPrev = chunk->lruNext = NULL;
+  return 0;
+}
+
+static int lruPushHead(struct chunkCache *cache, struct cachedChunk *chunk)
+{
+  chunk->lruPrev = NULL;
+  chunk->lruNext = cache->lruHead;
+  if (cache->lruHead) cache->lruHead->lruPrev = chunk;
+  else cache->lruTail = chunk;
+  cache->lruHead = chunk;
+  return 0;
+}
+
+// Keep the table at most half full, there is no fixed number of chunks any more
+static int tableReserve(struct chunkCache *cache, int count)
+{
+  int size = cache->tableMask + 1;
+  if (count * 2 <= size)
+    return 0;
+  while (count * 2 > size)
+    size <<= 1;
+  struct cachedChunk **table = calloc(size, sizeof(struct cachedChunk *));
+  if (!table) return -1;
+  free(cache->table);
+  cache->table = table;
+  cache->tableMask = size - 1;
+  for (struct cachedChunk *c = cache->lruHead; c; c = c->lruNext)
+    tableInsert(cache, c);
+  return 0;
+}
+
+static int entrySize(const struct cachedChunk *chunk)
+{
+  return sizeof(*chunk) + chunk->length;
+}
+
+// Throw away the least recently stored chunk
+static int evictOldest(struct chunkCache *cache)
+{
+  struct cachedChunk *oldest = cache->lruTail;
+  if (!oldest) return -1;
+  if (cache->onEvict)
+    cache->onEvict(oldest, cache->evictUser);
+  tableRemove(cache, tableFind(cache, oldest->x, oldest->y));
+  lruUnlink(cache, oldest);
+  cache->count--;
+  cache->used -= entrySize(oldest);
+  free(oldest);
+  return 0;
+}
+
+// Round towards minus infinity, casting alone rounds towards 0
+static int floorInt(float v)
+{
+  int i = (int) v;
+  return i - (v < i);
+}
+
+struct tileCoord tileFromPos(Vector2 pos)
+{
+  return (struct tileCoord){ floorInt(pos.x), floorInt(pos.y) };
+}
+
+// Tiles in one flat run, the same order as the tiles array
+#define TILECOUNT (CHUNKSIZE * CHUNKSIZE)
+#define WORDCOUNT (TILECOUNT / 64)
+
+int chunkPack(const struct mapChunk *chunk, unsigned char *out)
+{
+  const unsigned char *tiles = (const unsigned char *) chunk->tiles;
+  uint64_t bits[WORDCOUNT];
+  int transitions = 0;
+  uint64_t carry = 0;
+  for (int w = 0; w < WORDCOUNT; ++w)
+  {
+    uint64_t word = 0;
+    for (int b = 0; b < 64; ++b)
+    {
+      // Anything other than 0 or 1 can't be a bit, keep the tiles as they are
+      if (tiles[w * 64 + b] > 1)
+      {
+        out[0] = CHUNKPACK_RAW;
+        memcpy(out + 1, tiles, TILECOUNT);
+        return 1 + TILECOUNT;
+      }
+      word |= (uint64_t) tiles[w * 64 + b] << b;
+    }
+    bits[w] = word;
+    // Every bit that differs from the one before starts a new run
+    transitions += __builtin_popcountll(word ^ (word << 1 | carry));
+    carry = word >> 63;
+  }
+
+  // Each run is 2 bytes, the first is of 0s and may be empty
+  int runs = transitions + 1;
+  if (2 * runs < WORDCOUNT * 8)
+  {
+    out[0] = CHUNKPACK_RUNS;
+    unsigned char *p = out + 1;
+    int last = 0;
+    carry = 0;
+    for (int w = 0; w < WORDCOUNT; ++w)
+    {
+      uint64_t t = bits[w] ^ (bits[w] << 1 | carry);
+      carry = bits[w] >> 63;
+      for (; t; t &= t - 1)
+      {
+        int start = w * 64 + __builtin_ctzll(t);
+        p[0] = (start - last) & 255;
+        p[1] = (start - last) >> 8;
+        p += 2;
+        last = start;
+      }
+    }
+    p[0] = (TILECOUNT - last) & 255;
+    p[1] = (TILECOUNT - last) >> 8;
+    return 1 + 2 * runs;
+  }
+
+  // Bytes rather than words so the files don't depend on byte order
+  out[0] = CHUNKPACK_BITS;
+  for (int w = 0; w < WORDCOUNT; ++w)
+    for (int i = 0; i < 8; ++i)
+      out[1 + w * 8 + i] = bits[w] >> (8 * i);
+  return 1 + WORDCOUNT * 8;
+}
+
+int chunkUnpack(struct mapChunk *chunk, const unsigned char *data, int length)
+{
+  char *tiles = (char *) chunk->tiles;
+  if (length < 1) return -1;
+  switch (data[0]) {
+  case CHUNKPACK_RUNS:
+  {
+    if ((length - 1) % 2) return -1;
+    int pos = 0;
+    for (int r = 0; r < (length - 1) / 2; ++r)
+    {
+      int run = data[1 + 2 * r] | data[2 + 2 * r] << 8;
+      if (pos + run > TILECOUNT) return -1;
+      // Runs take turns between 0s and 1s
+      memset(tiles + pos, r & 1, run);
+      pos += run;
+    }
+    return pos == TILECOUNT ? 0 : -1;
+  }
+  case CHUNKPACK_BITS:
+    if (length != 1 + WORDCOUNT * 8) return -1;
+    for (int i = 0; i < TILECOUNT; ++i)
+      tiles[i] = (data[1 + i / 8] >> (i % 8)) & 1;
+    return 0;
+  case CHUNKPACK_RAW:
+    if (length != 1 + TILECOUNT) return -1;
+    memcpy(tiles, data + 1, TILECOUNT);
+    return 0;
+  }
+  return -1;
+}
+
+int cacheInit(struct chunkCache *cache, size_t budget, int active)
+{
+  memset(cache, 0, sizeof(*cache));
+  cache->budget = budget;
+  cache->poolSize = active;
+  cache->tableMask = 63;
+  cache->pool = malloc(sizeof(struct mapChunk) * active);
+  cache->freeChunks = malloc(sizeof(struct mapChunk *) * active);
+  cache->table = calloc(cache->tableMask + 1, sizeof(struct cachedChunk *));
+  if (!cache->pool || !cache->freeChunks || !cache->table)
+  {
+    cacheFree(cache);
+    return -1;
+  }
+  return cacheReset(cache);
+}
+
+int cacheFree(struct chunkCache *cache)
+{
+  if (cache->table)
+    cacheReset(cache);
+  free(cache->pool);
+  free(cache->freeChunks);
+  free(cache->table);
+  memset(cache, 0, sizeof(*cache));
+  return 0;
+}
+
+int cacheReset(struct chunkCache *cache)
+{
+  while (cache->lruHead)
+  {
+    struct cachedChunk *next = cache->lruHead->lruNext;
+    free(cache->lruHead);
+    cache->lruHead = next;
+  }
+  memset(cache->table, 0, sizeof(struct cachedChunk *) * (cache->tableMask + 1));
+  cache->lruTail = NULL;
+  cache->count = 0;
+  cache->used = 0;
+  for (int i = 0; i < cache->poolSize; ++i)
+    cache->freeChunks[i] = &cache->pool[i];
+  cache->freeCount = cache->poolSize;
+  return 0;
+}
+
+int cacheHas(const struct chunkCache *cache, int x, int y)
+{
+  return tableFind(cache, x, y) != -1;
+}
+
+struct mapChunk *cacheTake(struct chunkCache *cache, int x, int y)
+{
+  int i = tableFind(cache, x, y);
+  if (i == -1 || !cache->freeCount) return NULL;
+  struct cachedChunk *cached = cache->table[i];
+  struct mapChunk *chunk = cache->freeChunks[--cache->freeCount];
+  chunkUnpack(chunk, cached->data, cached->length);
+  chunk->pos = (Vector2){ x, y };
+  // Only edited chunks are ever stored
+  chunk->edited = 1;
+  tableRemove(cache, i);
+  lruUnlink(cache, cached);
+  cache->count--;
+  cache->used -= entrySize(cached);
+  free(cached);
+  return chunk;
+}
+
+int cachePut(struct chunkCache *cache, struct mapChunk *chunk)
+{
+  cache->freeChunks[cache->freeCount++] = chunk;
+  if (!chunk->edited)
+    return 0;
+  unsigned char packed[CHUNKPACKMAX];
+  int length = chunkPack(chunk, packed);
+  return cachePutPacked(cache, (int) chunk->pos.x, (int) chunk->pos.y, packed, length);
+}
+
+int cachePutPacked(struct chunkCache *cache, int x, int y, const unsigned char *data, int length)
+{
+  struct cachedChunk *cached = malloc(sizeof(struct cachedChunk) + length);
+  if (!cached || tableReserve(cache, cache->count + 1))
+  {
+    // Out of memory, send it straight on to wherever evicted chunks go
+    struct cachedChunk spill = { x, y, length, (unsigned char *) data, NULL, NULL };
+    free(cached);
+    if (cache->onEvict)
+      cache->onEvict(&spill, cache->evictUser);
+    return -1;
+  }
+  cached->x = x;
+  cached->y = y;
+  cached->length = length;
+  cached->data = (unsigned char *)(cached + 1);
+  memcpy(cached->data, data, length);
+  tableInsert(cache, cached);
+  lruPushHead(cache, cached);
+  cache->count++;
+  cache->used += entrySize(cached);
+  while (cache->used > cache->budget && cache->lruTail)
+    evictOldest(cache);
+  return 0;
+}
+
+int cacheEach(const struct chunkCache *cache, int (*fn)(const struct cachedChunk *chunk, void *user), void *user)
+{
+  for (const struct cachedChunk *c = cache->lruTail; c; c = c->lruPrev)
+    fn(c, user);
+  return 0;
+}
+
+struct mapChunk *cacheNewChunk(struct chunkCache *cache, int x, int y)
+{
+  // Only runs dry if more chunks are active than the pool was sized for
+  if (!cache->freeCount)
+    return NULL;
+  struct mapChunk *chunk = cache->freeChunks[--cache->freeCount];
+  memset(chunk->tiles, 0, sizeof(chunk->tiles));
+  chunk->pos = (Vector2){ x, y };
+  chunk->edited = 0;
+  return chunk;
+}
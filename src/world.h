@@ -0,0 +1,99 @@
+#ifndef WORLD_H
+#define WORLD_H
+
+#include <stddef.h>
+#include <raylib.h>
+
+// Chunks are a power of two tiles wide so world tiles split into a chunk
+// and a tile in it with a shift and a mask
+#define CHUNKSHIFT 7
+#define CHUNKSIZE (1 << CHUNKSHIFT)
+#define CHUNKMASK (CHUNKSIZE - 1)
+#define TILECHUNK(t) ((t) >> CHUNKSHIFT)
+#define TILELOCAL(t) ((t) & CHUNKMASK)
+// The active chunks are a square reaching this many chunks out from the
+// player's chunk at most, the reach is picked at runtime
+#define ACTIVERADIUSMAX 3
+#define ACTIVESIDEMAX (2 * ACTIVERADIUSMAX + 1)
+// Largest a packed chunk can be (a format byte and every tile as is)
+#define CHUNKPACKMAX (1 + CHUNKSIZE * CHUNKSIZE)
+
+enum {CHUNKPACK_RUNS, CHUNKPACK_BITS, CHUNKPACK_RAW}; // Packed chunk formats, the first byte of the data
+
+// A tile in world coordinates, the tile (0, 0) covers positions 0 to 1
+struct tileCoord
+{
+  int x, y;
+};
+
+struct mapChunk
+{
+  char tiles[CHUNKSIZE][CHUNKSIZE];
+  Vector2 pos;
+  char edited; // Differs from what the generator makes, so it has to be kept
+};
+
+// An inactive chunk squeezed down with chunkPack
+struct cachedChunk
+{
+  int x, y;
+  int length;
+  unsigned char *data;
+  // Links in the chunk cache's least recently used list
+  struct cachedChunk *lruPrev;
+  struct cachedChunk *lruNext;
+};
+
+// Chunks that aren't active, found by their chunk coordinates and kept
+// packed. The active chunks come from a small pool of full sized ones.
+struct chunkCache
+{
+  struct mapChunk *pool;
+  struct mapChunk **freeChunks;
+  int freeCount;
+  int poolSize;
+  struct cachedChunk **table;  // Open addressing on chunk coordinates
+  int tableMask;
+  struct cachedChunk *lruHead; // Most recently stored
+  struct cachedChunk *lruTail; // First to be thrown away
+  int count;
+  size_t used;   // Bytes taken by the cached chunks
+  size_t budget; // Bytes they may take before the oldest are thrown away
+  // Called with each chunk about to be thrown away, so it can be kept somewhere else
+  int (*onEvict)(const struct cachedChunk *chunk, void *user);
+  void *evictUser;
+};
+
+// The tile a world position is on
+struct tileCoord tileFromPos(Vector2 pos);
+
+// Pack a chunk's tiles into out (CHUNKPACKMAX bytes), returns the length.
+// Tiles that are only 0 or 1 become a bitmap, or runs of the same tile if
+// that is smaller.
+int chunkPack(const struct mapChunk *chunk, unsigned char *out);
+// Fill in a chunk's tiles from packed data, returns -1 if it is broken
+int chunkUnpack(struct mapChunk *chunk, const unsigned char *data, int length);
+
+// budget is how many bytes of packed chunks are kept, active is how many
+// full chunks can be active at once
+int cacheInit(struct chunkCache *cache, size_t budget, int active);
+int cacheFree(struct chunkCache *cache);
+// Forget every chunk, cached or active
+int cacheReset(struct chunkCache *cache);
+// Take a chunk out of the cache and unpack it, NULL if it isn't there
+struct mapChunk *cacheTake(struct chunkCache *cache, int x, int y);
+// Whether the cache holds chunk (x, y)
+int cacheHas(const struct chunkCache *cache, int x, int y);
+// Pack and store a chunk that is no longer active, dropping the oldest ones
+// when over budget. The full chunk goes back to the pool. Chunks that were
+// never edited aren't stored, they can be generated again.
+int cachePut(struct chunkCache *cache, struct mapChunk *chunk);
+// Store a chunk that is already packed, as cachePut does
+int cachePutPacked(struct chunkCache *cache, int x, int y, const unsigned char *data, int length);
+// Call fn with every cached chunk, the oldest first, so putting them back
+// in that order gives the same cache
+int cacheEach(const struct chunkCache *cache, int (*fn)(const struct cachedChunk *chunk, void *user), void *user);
+// Get an empty chunk from the pool for the given chunk coordinates
+struct mapChunk *cacheNewChunk(struct chunkCache *cache, int x, int y);
+
+#endif /* WORLD_H */
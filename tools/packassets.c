@@ -0,0 +1,86 @@
+// Packs images into the asset bundle the game maps at startup, decoding
+// them here so the game doesn't have to. Built and run by build-linux.sh
+// with raylib's copy of stb_image:
+//   packassets out.pak image.png...
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_PNG
+#include "stb_image.h"
+#include "../src/bundle.h"
+
+static long alignUp(long n, long to)
+{
+  return (n + to - 1) / to * to;
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc < 3)
+  {
+    fprintf(stderr, "Usage: %s out.pak image.png...\n", argv[0]);
+    return 1;
+  }
+  int count = argc - 2;
+  struct bundleEntry *index = calloc(count, sizeof(*index));
+  unsigned char **pixels = calloc(count, sizeof(*pixels));
+  if (!index || !pixels)
+    return 1;
+
+  long offset = alignUp(sizeof(struct bundleHeader) + count * sizeof(*index), BUNDLEALIGN);
+  for (int i = 0; i < count; ++i)
+  {
+    const char *path = argv[i + 2];
+    // Entries are named by file name only, which is what the game asks for
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+    if (strlen(name) >= BUNDLENAMESIZE)
+    {
+      fprintf(stderr, "%s: name is longer than %d characters\n", path, BUNDLENAMESIZE - 1);
+      return 1;
+    }
+    int w, h, channels;
+    pixels[i] = stbi_load(path, &w, &h, &channels, 4);
+    if (!pixels[i])
+    {
+      fprintf(stderr, "%s: %s\n", path, stbi_failure_reason());
+      return 1;
+    }
+    strcpy(index[i].name, name);
+    index[i].width = w;
+    index[i].height = h;
+    index[i].offset = offset;
+    index[i].length = w * h * 4;
+    offset = alignUp(offset + index[i].length, BUNDLEALIGN);
+  }
+
+  // Written under another name first, a failed pack never leaves half a bundle
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", argv[1]);
+  FILE *out = fopen(tmp, "wb");
+  if (!out)
+  {
+    perror(tmp);
+    return 1;
+  }
+  struct bundleHeader header = { BUNDLEMAGIC, BUNDLEVERSION, count, 0 };
+  int ok = fwrite(&header, sizeof(header), 1, out) == 1 &&
+    fwrite(index, sizeof(*index), count, out) == (size_t) count;
+  for (int i = 0; ok && i < count; ++i)
+  {
+    // Zero padding up to the image's offset
+    ok = fseek(out, index[i].offset, SEEK_SET) == 0 &&
+      fwrite(pixels[i], 1, index[i].length, out) == (size_t) index[i].length;
+    stbi_image_free(pixels[i]);
+  }
+  long size = ftell(out);
+  if (fclose(out) || !ok || rename(tmp, argv[1]))
+  {
+    perror(argv[1]);
+    remove(tmp);
+    return 1;
+  }
+  printf("Packed %d images into %s (%ld bytes)\n", count, argv[1], size);
+  return 0;
+}